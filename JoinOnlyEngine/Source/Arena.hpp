@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace boss::engines::joinonly {
+
+/**
+ * A bump allocator for short-lived state (e.g., the partial results of a morsel): allocating moves
+ * a pointer forward in the current block, deallocating does nothing, and reset() frees everything
+ * at once.
+ *
+ * The blocks are kept across resets, up to retainedBytes, so that, once warmed up, an arena does
+ * not call the global heap anymore (the blocks beyond, e.g., of a morsel with many more matches
+ * than the others, are freed by reset()). It is not thread-safe: each worker has its own.
+ *
+ * As deallocating does nothing, a vector that grows strands its previous buffers until the next
+ * reset: reserve the expected sizes up-front where they are known.
+ *
+ * Containers allocate from it through std::pmr, e.g., std::pmr::vector<size_t> v(&arena).
+ */
+class Arena : public std::pmr::memory_resource {
+public:
+  explicit Arena(size_t blockBytes = defaultBlockBytes,
+                 size_t retainedBytes = defaultRetainedBytes)
+      : blockBytes(blockBytes), retainedBytes(retainedBytes) {}
+  Arena(Arena const&) = delete;
+  Arena& operator=(Arena const&) = delete;
+  ~Arena() override = default;
+
+  /// frees all the allocations (the containers allocated from the arena must not be used anymore)
+  void reset() {
+    current = 0;
+    used = 0;
+    size_t keptBytes = 0;
+    auto kept = blocks.begin();
+    while(kept != blocks.end() && keptBytes + kept->size <= retainedBytes) {
+      keptBytes += kept->size;
+      ++kept;
+    }
+    blocks.erase(kept, blocks.end());
+  }
+
+private:
+  static constexpr size_t defaultBlockBytes = size_t(1) << 20; // NOLINT(readability-magic-numbers)
+  static constexpr size_t defaultRetainedBytes = size_t(8) << 20; // NOLINT
+
+  struct Block {
+    std::unique_ptr<std::byte[]> data; // NOLINT(cppcoreguidelines-avoid-c-arrays)
+    size_t size;
+  };
+  size_t blockBytes;
+  size_t retainedBytes;
+  std::vector<Block> blocks;
+  /// the block allocated from, and how much of it is used
+  size_t current = 0;
+  size_t used = 0;
+
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    while(current < blocks.size()) {
+      auto const address = reinterpret_cast<std::uintptr_t>(blocks[current].data.get()) + used;
+      auto const padding = (alignment - address % alignment) % alignment;
+      if(used + padding + bytes <= blocks[current].size) {
+        used += padding + bytes;
+        return blocks[current].data.get() + (used - bytes);
+      }
+      current++; // (the rest of the block stays unused until the next reset)
+      used = 0;
+    }
+    // a new block, large enough for the allocation
+    auto const size = std::max(blockBytes, bytes + alignment);
+    // (not zeroed: the pages are only touched once allocated from)
+    blocks.push_back({std::unique_ptr<std::byte[]>(new std::byte[size]), size}); // NOLINT
+    return do_allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* /*p*/, size_t /*bytes*/, size_t /*alignment*/) override {}
+
+  bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+} // namespace boss::engines::joinonly
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+namespace boss::engines::joinonly {
+
+/**
+ * @brief The bits of a key to hash: equal keys have the same bits (-0.0 and 0.0 included).
+ */
+inline uint64_t toHashBits(int64_t key) { return static_cast<uint64_t>(key); }
+inline uint64_t toHashBits(double key) {
+  if(key == 0) {
+    key = 0; // -0.0 and 0.0 are equal
+  }
+  uint64_t bits = 0;
+  std::memcpy(&bits, &key, sizeof(bits));
+  return bits;
+}
+
+/**
+ * @brief Mixes the bits of a key (the finalizer of MurmurHash3): all the bits of the key affect all
+ * the bits of the hash, so that any of them can be used to pick a slot (or a word of a filter).
+ */
+inline uint64_t mixHash(uint64_t bits) {
+  bits ^= bits >> 33;            // NOLINT(readability-magic-numbers)
+  bits *= 0xff51afd7ed558ccdULL; // NOLINT(readability-magic-numbers)
+  bits ^= bits >> 33;            // NOLINT(readability-magic-numbers)
+  bits *= 0xc4ceb9fe1a85ec53ULL; // NOLINT(readability-magic-numbers)
+  return bits ^ (bits >> 33);    // NOLINT(readability-magic-numbers)
+}
+
+/// whether a key never matches any other (NaN), not even itself
+template <typename Key> bool isUnmatchable(Key const& key) {
+  if constexpr(std::is_floating_point_v<Key>) {
+    return std::isnan(key);
+  } else {
+    return false;
+  }
+}
+
+/**
+ * A register-blocked Bloom filter: all the bits of a key are in the same 64-bit word, so that a
+ * lookup costs a single memory access (and a single cache miss at most).
+ *
+ * It answers "definitely not in the set" or "maybe in the set": it is used to reject the keys that
+ * have no match before looking them up in a hash table. Keys that never match (NaN) are never
+ * in the set.
+ */
+class BloomFilter {
+public:
+  BloomFilter() = default;
+
+  /// sizes the filter for about `bitsPerKey` bits per key (rounded up to a power of two words)
+  explicit BloomFilter(size_t expectedKeys) {
+    size_t numWords = 2;
+    while(numWords * wordBits < expectedKeys * bitsPerKey) {
+      numWords *= 2;
+    }
+    words.resize(numWords, 0);
+    shift = wordBits;
+    for(auto n = numWords; n > 1; n /= 2) {
+      shift--;
+    }
+  }
+
+  template <typename Key> void insert(Key const& key) {
+    if(isUnmatchable(key)) {
+      return;
+    }
+    auto hash = mixHash(toHashBits(key));
+    words[hash >> shift] |= mask(hash);
+  }
+
+  template <typename Key> bool mayContain(Key const& key) const {
+    if(isUnmatchable(key) || words.empty()) {
+      return false;
+    }
+    auto hash = mixHash(toHashBits(key));
+    auto const keyMask = mask(hash);
+    return (words[hash >> shift] & keyMask) == keyMask;
+  }
+
+private:
+  static constexpr unsigned wordBits = 64;
+  static constexpr size_t bitsPerKey = 16;
+  static constexpr unsigned bitsSetPerKey = 4;
+
+  std::vector<uint64_t> words;
+  /// the word of a key is given by the high bits of its hash
+  unsigned shift = wordBits;
+
+  /// the bits to set in the word of a key: from the low bits of its hash (6 bits for each)
+  static uint64_t mask(uint64_t hash) {
+    uint64_t keyMask = 0;
+    for(unsigned i = 0; i < bitsSetPerKey; i++) {
+      keyMask |= uint64_t(1) << ((hash >> (i * 6)) & (wordBits - 1)); // NOLINT
+    }
+    return keyMask;
+  }
+};
+
+} // namespace boss::engines::joinonly
@@ -1,24 +1,193 @@
 #include "Competition.hpp"
 #include "Common.hpp"
 
+#include "HashJoin.hpp"
+#include "JoinOrder.hpp"
+#include "NestedLoopJoin.hpp"
+#include "SemiJoinReduction.hpp"
 #include "SimplificationLayer.hpp"
+#include "SortMergeJoin.hpp"
+#include "ThreadPool.hpp"
 #include <Algorithm.hpp>
 #include <Expression.hpp>
 #include <ExpressionUtilities.hpp>
 #include <Utilities.hpp>
 #include <mutex>
+#include <thread>
 
-namespace boss::engines::joinonly {
+using boss::utilities::operator""_;
+
+// Each engine has a namespace of its own: the engines are loaded in the same process, where the
+// symbols of their templates (e.g., the std::visit tables of their lambdas) must not collide.
+namespace boss::engines::joinonly::competition {
 using std::vector;
 
+/// the algorithms that the engine chooses from, for each step of a join
+enum class JoinAlgorithm { Adaptive = 0, NestedLoop, Hash, RadixPartitionedHash, SortMerge };
+
 class Engine {
+  /// whether to drop the dangling rows of the inputs (with semi-joins) before joining them
+  bool semiJoinReduction = false;
+  /// whether to choose the join order from the data (otherwise, the last table probes backwards)
+  bool joinOrdering = true;
+  /// the algorithm of every join step (Adaptive chooses one per step)
+  JoinAlgorithm algorithm = JoinAlgorithm::Adaptive;
+  /// over this many bytes of hash table, a join step is a sort-merge join (0 for no budget)
+  int64_t memoryBudget = 0;
+  /// a step with fewer pairs of keys to compare than this is a nested-loop join
+  int64_t nestedLoopMaxPairs = 4096; // NOLINT(readability-magic-numbers)
+  /// hash tables over at least that many keys are radix-partitioned to stay in cache
+  int64_t radixPartitioningMinRows = int64_t(1) << 16; // NOLINT(readability-magic-numbers)
+  /// the number of radix-partitioning passes
+  int64_t radixPartitioningPasses = 1;
+  /// the workers for the partition-wise joins (the calling thread is one of them)
+  std::unique_ptr<ThreadPool> threadPool =
+      std::make_unique<ThreadPool>(std::max(std::thread::hardware_concurrency(), 1U));
+
+  /**
+   * @brief Changes the configuration of the engine, e.g., "Set"_("SemiJoinReduction"_, 1).
+   *
+   * @return false if the option is not one of this engine's.
+   */
+  bool setOption(Symbol const& option, int64_t value) {
+    if(option == "SemiJoinReduction"_) {
+      semiJoinReduction = value != 0;
+      return true;
+    }
+    if(option == "JoinOrdering"_) {
+      joinOrdering = value != 0;
+      return true;
+    }
+    if(option == "JoinAlgorithm"_) {
+      if(value < (int64_t)JoinAlgorithm::Adaptive || value > (int64_t)JoinAlgorithm::SortMerge) {
+        throw std::runtime_error("unknown join algorithm: " + std::to_string(value));
+      }
+      algorithm = static_cast<JoinAlgorithm>(value);
+      return true;
+    }
+    if(option == "MemoryBudget"_) {
+      memoryBudget = std::max<int64_t>(value, 0);
+      return true;
+    }
+    if(option == "NestedLoopMaxPairs"_) {
+      nestedLoopMaxPairs = value;
+      return true;
+    }
+    if(option == "RadixPartitioningMinRows"_) {
+      radixPartitioningMinRows = value;
+      return true;
+    }
+    if(option == "RadixPartitioningPasses"_) {
+      radixPartitioningPasses = std::max<int64_t>(value, 1);
+      return true;
+    }
+    if(option == "Threads"_) {
+      threadPool.reset(); // join the current threads first
+      threadPool = std::make_unique<ThreadPool>(std::max<int64_t>(value, 1));
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Joins the partial results (their probe keys) with the next table, with the algorithm
+   * that suits the inputs of this step best:
+   * - tiny inputs: a nested-loop join, which has no set-up cost;
+   * - inputs that are both sorted already (e.g., IDs): a merge, without the sorting;
+   * - otherwise, a hash join built on the side with the smaller hash table (given the duplicates
+   * of the keys on each side), radix-partitioned if it does not fit in cache;
+   * - unless that hash table does not fit in the memory budget (if any): a sort-merge join, which
+   * only needs the keys and their row ids.
+   */
+  template <typename Key>
+  simplificationLayer::StepMatches
+  joinStep(simplificationLayer::TypedColumn<Key> const& buildColumn, vector<Key>&& probeKeys) {
+    auto chosen = algorithm;
+    bool buildOnProbeKeys = false;
+    if(chosen == JoinAlgorithm::Adaptive) {
+      auto const buildSize = buildColumn.size();
+      auto const probeSize = probeKeys.size();
+      if((double)buildSize * (double)probeSize <= (double)nestedLoopMaxPairs) {
+        chosen = JoinAlgorithm::NestedLoop;
+      } else if(isSorted(buildColumn.data(), buildSize) &&
+                isSorted(probeKeys.data(), probeSize)) {
+        chosen = JoinAlgorithm::SortMerge;
+      } else {
+        auto const buildBytes = HashTable<Key>::estimateBytes(
+            buildSize, simplificationLayer::estimateDistinctCount(buildColumn));
+        auto const probeBytes = HashTable<Key>::estimateBytes(
+            probeSize, simplificationLayer::estimateDistinctCount(probeKeys));
+        buildOnProbeKeys = probeBytes < buildBytes;
+        if(memoryBudget > 0 && std::min(buildBytes, probeBytes) > (double)memoryBudget) {
+          chosen = JoinAlgorithm::SortMerge;
+        } else if((buildOnProbeKeys ? probeSize : buildSize) >= (size_t)radixPartitioningMinRows) {
+          chosen = JoinAlgorithm::RadixPartitionedHash;
+        } else {
+          chosen = JoinAlgorithm::Hash;
+        }
+      }
+    }
+    switch(chosen) {
+    case JoinAlgorithm::NestedLoop:
+      return nestedLoopJoinMatches(buildColumn, probeKeys);
+    case JoinAlgorithm::SortMerge:
+      return sortMergeJoinMatches(buildColumn, probeKeys);
+    case JoinAlgorithm::RadixPartitionedHash:
+      if(buildOnProbeKeys) {
+        auto matches = radixPartitionedJoinMatches(
+            simplificationLayer::TypedColumn<Key>(std::move(probeKeys)),
+            vector<Key>(buildColumn.begin(), buildColumn.end()), radixPartitioningPasses, true,
+            *threadPool);
+        std::swap(matches.partialIndices, matches.rows);
+        return matches;
+      }
+      return radixPartitionedJoinMatches(buildColumn, std::move(probeKeys), radixPartitioningPasses,
+                                         true, *threadPool);
+    default:
+      if(buildOnProbeKeys) {
+        auto matches = hashJoinMatches(probeKeys.data(), probeKeys.size(), buildColumn.data(),
+                                       buildColumn.size());
+        std::swap(matches.partialIndices, matches.rows);
+        return matches;
+      }
+      return hashJoinMatches(buildColumn.data(), buildColumn.size(), probeKeys.data(),
+                             probeKeys.size());
+    }
+  }
+
   simplificationLayer::JoinHelper performMultiwayJoin(simplificationLayer::JoinHelper&& helper) {
 
     ////////////////////////////////////////////////////////////////////////////////
     ///////////////// this is the code that is relevant to students ////////////////
     ////////////////////////////////////////////////////////////////////////////////
 
-    // Knock yourself out :)
+    if(semiJoinReduction) {
+      simplificationLayer::semiJoinReduce(helper);
+    }
+    auto const& input = helper.getInputs();
+    auto const order = joinOrdering ? simplificationLayer::optimizeJoinOrder(helper)
+                                    : simplificationLayer::backwardJoinOrder(helper);
+
+    // the partial results: rows of the tables joined so far (a vector per table)
+    auto partial = simplificationLayer::allRowsOf(input, order.probeTable);
+    vector<size_t> joinedTables = {order.probeTable};
+    for(auto const& step : order.steps) {
+      simplificationLayer::StepMatches matches;
+      simplificationLayer::visitSameTypeColumns(
+          input[step.table][step.key.column], input[step.probeKey.table][step.probeKey.column],
+          [&](auto const& buildColumn, auto const& probeColumn) {
+            matches = joinStep(buildColumn, simplificationLayer::gatherKeys(
+                                                probeColumn, partial[step.probeKey.table]));
+          });
+      // (if the join attributes have different types, nothing matches)
+      partial =
+          simplificationLayer::extendPartialResults(input, step, partial, joinedTables, matches);
+      joinedTables.push_back(step.table);
+      if(partial[step.table].empty()) {
+        break; // nothing left to join (and every vector of row ids is empty)
+      }
+    }
+    helper.appendOutputRowIds(std::move(partial));
 
     ////////////////////////////////////////////////////////////////////////////////
     /////////////////// end of code that is relevant to students ///////////////////
@@ -31,7 +200,14 @@ public:
     try {
       return visit(boss::utilities::overload(
                        [this](ComplexExpression&& e) -> Expression {
-                         if(e.getHead().getName() == "Join") {
+                         auto const& args = e.getDynamicArguments();
+                         if(e.getHead() == "Set"_ && args.size() == 2 &&
+                            std::holds_alternative<Symbol>(args[0]) &&
+                            std::holds_alternative<int64_t>(args[1]) &&
+                            setOption(get<Symbol>(args[0]), get<int64_t>(args[1]))) {
+                           return true;
+                         }
+                         if(simplificationLayer::JoinHelper::isJoinPlan(e)) {
                            return performMultiwayJoin(simplificationLayer::JoinHelper(std::move(e)))
                                .getResult();
                          } else {
@@ -57,12 +233,14 @@ public:
   }
 };
 
-} // namespace boss::engines::joinonly
+} // namespace boss::engines::joinonly::competition
+
+using boss::engines::joinonly::competition::Engine;
 
 static auto& enginePtr(bool initialise = true) {
-  static auto engine = std::unique_ptr<boss::engines::joinonly::Engine>();
+  static auto engine = std::unique_ptr<Engine>();
   if(!engine && initialise) {
-    engine.reset(new boss::engines::joinonly::Engine());
+    engine.reset(new Engine());
   }
   return engine;
 }
@@ -0,0 +1,280 @@
+#pragma once
+
+#include "HashJoin.hpp"
+#include "JoinOrder.hpp"
+#include "SimplificationLayer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace boss::engines::joinonly {
+using std::vector;
+
+/**
+ * A temporary file (deleted when closed) that records are spilled to, with large sequential
+ * writes, and read back mapped in memory (or read into memory where mmap is not available).
+ */
+template <typename Record> class SpillFile {
+  static_assert(std::is_trivially_copyable_v<Record>);
+
+public:
+  SpillFile() : file(std::tmpfile()) {
+    if(file == nullptr) {
+      throw std::runtime_error("cannot create a temporary file to spill to");
+    }
+    std::setvbuf(file, nullptr, _IONBF, 0); // the records are buffered by the caller
+  }
+  SpillFile(SpillFile const&) = delete;
+  SpillFile& operator=(SpillFile const&) = delete;
+  ~SpillFile() {
+    unmap();
+    std::fclose(file);
+  }
+
+  void append(Record const* records, size_t count) {
+    if(count > 0 && std::fwrite(records, sizeof(Record), count, file) != count) {
+      throw std::runtime_error("cannot write to a spill file (is the disk full?)");
+    }
+    size += count;
+  }
+
+  size_t getSize() const { return size; }
+
+  /// the records written so far (valid until unmap() is called)
+  Record const* map() {
+    if(size == 0) {
+      return nullptr;
+    }
+    std::fflush(file);
+#ifndef _WIN32
+    mapped = mmap(nullptr, size * sizeof(Record), PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    if(mapped == MAP_FAILED) {
+      mapped = nullptr;
+      throw std::runtime_error("cannot map a spill file");
+    }
+    madvise(mapped, size * sizeof(Record), MADV_SEQUENTIAL);
+    return static_cast<Record const*>(mapped);
+#else
+    readBack.resize(size);
+    std::rewind(file);
+    if(std::fread(readBack.data(), sizeof(Record), size, file) != size) {
+      throw std::runtime_error("cannot read a spill file");
+    }
+    return readBack.data();
+#endif
+  }
+
+  void unmap() {
+#ifndef _WIN32
+    if(mapped != nullptr) {
+      munmap(mapped, size * sizeof(Record));
+      mapped = nullptr;
+    }
+#else
+    vector<Record>().swap(readBack);
+#endif
+  }
+
+private:
+  std::FILE* file;
+  size_t size = 0;
+#ifndef _WIN32
+  void* mapped = nullptr;
+#else
+  vector<Record> readBack;
+#endif
+};
+
+/**
+ * Records hash-partitioned into spill files: each partition buffers its records in memory and
+ * writes them to its file when the buffer is full.
+ */
+template <typename Record> class SpilledPartitions {
+public:
+  SpilledPartitions(size_t numPartitions, size_t bufferBytes)
+      : bufferSize(std::max<size_t>(bufferBytes / sizeof(Record), 1)), buffers(numPartitions) {
+    files.reserve(numPartitions);
+    for(size_t p = 0; p < numPartitions; p++) {
+      files.push_back(std::make_unique<SpillFile<Record>>());
+      buffers[p].reserve(bufferSize);
+    }
+  }
+
+  void add(size_t partition, Record const& record) {
+    auto& buffer = buffers[partition];
+    buffer.push_back(record);
+    if(buffer.size() == bufferSize) {
+      files[partition]->append(buffer.data(), buffer.size());
+      buffer.clear();
+    }
+  }
+
+  /// writes the records left in the buffers (and frees them): the partitions are then read only
+  void flush() {
+    for(size_t p = 0; p < buffers.size(); p++) {
+      files[p]->append(buffers[p].data(), buffers[p].size());
+      vector<Record>().swap(buffers[p]);
+    }
+  }
+
+  SpillFile<Record>& operator[](size_t partition) { return *files[partition]; }
+
+private:
+  size_t bufferSize;
+  vector<vector<Record>> buffers;
+  vector<std::unique_ptr<SpillFile<Record>>> files;
+};
+
+/// a key spilled along with its id (a row of the build table, or the index of a partial result)
+template <typename Key> struct SpilledKey {
+  Key key;
+  size_t id;
+};
+
+/// the number of partitions is limited, as each one keeps a file open (for each side)
+constexpr unsigned maxSpillPartitionBits = 7;
+/// the write buffers of all the partitions of a side take (at most) that share of the budget
+/// (with a buffer of at least one record per partition: a tiny budget makes for small writes)
+constexpr size_t spillBufferShare = 8;
+constexpr size_t maxSpillBufferBytes = size_t(1) << 20; // NOLINT(readability-magic-numbers)
+
+/**
+ * @brief Joins probe keys with a build column that does not fit in the memory budget, with the
+ * grace hash join.
+ *
+ * Both sides are hash-partitioned into spill files, with enough partitions for the hash table of
+ * each build partition to fit in the budget. The partitions are then joined one at a time: the
+ * build partition is read back and hashed, and its probe partition is streamed through it. Only
+ * one partition of each side is in memory at once.
+ *
+ * The partitions are split once (into at most 2^maxSpillPartitionBits): a partition that is still
+ * too large, e.g., made of many duplicates of the same key, may go over the budget.
+ *
+ * The budget covers the hash tables and the write buffers of the partitions (an eighth of it for
+ * each side): the probe rows and the matches (which the caller turns into partial results) are
+ * not accounted for.
+ *
+ * @param onMatches Called with the matches of each partition, as (index in probeRows, row of
+ * buildColumn) pairs, in turn (so that the matches of a single partition are in memory at once).
+ */
+template <typename Key, typename OnMatches>
+void graceHashJoinMatches(simplificationLayer::TypedColumn<Key> const& buildColumn,
+                          simplificationLayer::TypedColumn<Key> const& probeColumn,
+                          vector<size_t> const& probeRows, size_t memoryBudget,
+                          OnMatches&& onMatches) {
+  auto const buildBytes = HashTable<Key>::estimateBytes(
+      buildColumn.size(), static_cast<double>(buildColumn.size()));
+  unsigned bits = 1;
+  while(bits < maxSpillPartitionBits &&
+        buildBytes / static_cast<double>(size_t(1) << bits) > static_cast<double>(memoryBudget)) {
+    bits++;
+  }
+  auto const numPartitions = size_t(1) << bits;
+  auto const bufferBytes =
+      std::min(memoryBudget / spillBufferShare / numPartitions, maxSpillBufferBytes);
+  auto const partitionOf = [shift = 64 - bits](Key const& key) { return radixHash(key) >> shift; };
+
+  SpilledPartitions<SpilledKey<Key>> build(numPartitions, bufferBytes);
+  for(size_t row = 0; row < buildColumn.size(); row++) {
+    if(!isUnmatchable(buildColumn[row])) {
+      build.add(partitionOf(buildColumn[row]), {buildColumn[row], row});
+    }
+  }
+  build.flush();
+  SpilledPartitions<SpilledKey<Key>> probe(numPartitions, bufferBytes);
+  for(size_t index = 0; index < probeRows.size(); index++) {
+    auto const& key = probeColumn[probeRows[index]];
+    if(!isUnmatchable(key)) {
+      probe.add(partitionOf(key), {key, index});
+    }
+  }
+  probe.flush();
+
+  for(size_t p = 0; p < numPartitions; p++) {
+    auto const buildSize = build[p].getSize();
+    auto const probeSize = probe[p].getSize();
+    if(buildSize == 0 || probeSize == 0) {
+      continue;
+    }
+    auto const* buildRecords = build[p].map();
+    vector<Key> buildKeys(buildSize);
+    for(size_t i = 0; i < buildSize; i++) {
+      buildKeys[i] = buildRecords[i].key;
+    }
+    auto const hashTable = buildHashTable(buildKeys.data(), buildSize);
+    auto const* probeRecords = probe[p].map();
+    simplificationLayer::StepMatches matches;
+    for(size_t i = 0; i < probeSize; i++) {
+      for(auto position : lookup(hashTable, probeRecords[i].key)) {
+        matches.partialIndices.push_back(probeRecords[i].id);
+        matches.rows.push_back(buildRecords[position].id);
+      }
+    }
+    build[p].unmap();
+    probe[p].unmap();
+    onMatches(matches);
+  }
+}
+
+/**
+ * @brief The memory taken by the hash tables of all the steps of a join order (as built by the
+ * in-memory hash join, all at once).
+ */
+inline double estimateHashTablesBytes(vector<simplificationLayer::Table> const& input,
+                                      simplificationLayer::JoinOrder const& order) {
+  double bytes = 0;
+  for(auto const& step : order.steps) {
+    bytes += std::visit(
+        [](auto const& keys) {
+          using Key = typename std::decay_t<decltype(keys)>::value_type;
+          return HashTable<Key>::estimateBytes(keys.size(), static_cast<double>(keys.size()));
+        },
+        input[step.table][step.key.column]);
+  }
+  return bytes;
+}
+
+/**
+ * @brief Joins the inputs with the grace hash join, one step of the join order at a time (so that
+ * a single hash table is built at once, one partition at a time).
+ *
+ * The memory budget bounds the hash tables (the build side): the partial results of each step
+ * are kept in memory, as with the in-memory hash join.
+ *
+ * @return The result rows, as one vector of row indices per input table.
+ */
+inline simplificationLayer::RowIds graceHashJoin(vector<simplificationLayer::Table> const& input,
+                                                 simplificationLayer::JoinOrder const& order,
+                                                 size_t memoryBudget) {
+  // the partial results: rows of the tables joined so far (a vector per table)
+  auto partial = simplificationLayer::allRowsOf(input, order.probeTable);
+  vector<size_t> joinedTables = {order.probeTable};
+  for(auto const& step : order.steps) {
+    // (the matches of each partition extend the partial results as soon as they are found)
+    simplificationLayer::RowIds next(input.size());
+    simplificationLayer::visitSameTypeColumns(
+        input[step.table][step.key.column], input[step.probeKey.table][step.probeKey.column],
+        [&](auto const& buildColumn, auto const& probeColumn) {
+          graceHashJoinMatches(buildColumn, probeColumn, partial[step.probeKey.table],
+                               memoryBudget, [&](auto const& matches) {
+                                 simplificationLayer::appendPartialResults(
+                                     input, step, partial, joinedTables, matches, next);
+                               });
+        });
+    // (if the join attributes have different types, nothing matches)
+    partial = std::move(next);
+    if(partial[step.table].empty()) {
+      return simplificationLayer::RowIds(input.size());
+    }
+    joinedTables.push_back(step.table);
+  }
+  return partial;
+}
+
+} // namespace boss::engines::joinonly
@@ -0,0 +1,441 @@
+#pragma once
+
+#include "BloomFilter.hpp"
+#include "JoinOrder.hpp"
+#include "Simd.hpp"
+#include "SimplificationLayer.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <variant>
+#include <vector>
+
+namespace boss::engines::joinonly {
+using std::vector;
+
+/// the row indices holding a key in a hash table (empty if there is none)
+class RowRange {
+public:
+  RowRange() = default;
+  RowRange(size_t const* first, size_t const* last) : first(first), last(last) {}
+  size_t const* begin() const { return first; }
+  size_t const* end() const { return last; }
+  bool empty() const { return first == last; }
+  size_t size() const { return last - first; }
+
+private:
+  size_t const* first = nullptr;
+  size_t const* last = nullptr;
+};
+
+/**
+ * Open-addressing hash table over the values of a typed key column (Swiss-table layout).
+ *
+ * The slots are split into groups of 16. Each slot has a control byte: empty, or 7 bits of the
+ * hash of its key (a fingerprint). A lookup compares the fingerprint with the control bytes of a
+ * whole group at once (with SSE2, or a scalar loop elsewhere), and only compares the keys of the
+ * slots whose fingerprints match: most lookups touch one cache line of control bytes and one key.
+ * The keys and the row indices holding each of them are in separate dense arrays.
+ */
+template <typename Key> class HashTable {
+public:
+  /// the (approximate) memory footprint of a hash table over that many keys (and distinct ones)
+  static double estimateBytes(size_t numKeys, double distinctKeys) {
+    // (the table grows by doubling: on average, a bit less than twice the slots needed)
+    auto const numSlots = 1.5 * 8.0 / 7 * distinctKeys; // NOLINT(readability-magic-numbers)
+    return numSlots * (sizeof(int8_t) + sizeof(Key) + sizeof(size_t)) +
+           static_cast<double>(numKeys) * sizeof(size_t);
+  }
+
+  HashTable() = default;
+
+  /**
+   * @brief Builds a hash table over typed keys, in two passes (without an allocation per key).
+   *
+   * The first pass inserts the distinct keys and counts their rows (the table grows so that at
+   * most 7/8 of the slots are used). The row indices of all the keys are then stored in a single
+   * array, grouped by key (as in a CSR matrix): the rows of the key in slot s are
+   * [offsets[s], offsets[s + 1]). The second pass fills that array.
+   *
+   * @param keys The join attribute values of the build table.
+   * @param size The number of keys.
+   */
+  HashTable(Key const* keys, size_t size) {
+    resize(1);
+    // count
+    vector<size_t> counts(control.size(), 0);
+    for(size_t i = 0; i < size; i++) {
+      if(isUnmatchable(keys[i])) {
+        continue; // never matches anything
+      }
+      auto const hash = mixHash(toHashBits(keys[i]));
+      auto slot = findSlot(keys[i], hash);
+      if(control[slot] == emptyControl) {
+        if((numDistinctKeys + 1) * 8 > control.size() * 7) { // NOLINT(readability-magic-numbers)
+          grow(counts);
+          slot = findSlot(keys[i], hash);
+        }
+        control[slot] = fingerprint(hash);
+        slotKeys[slot] = keys[i];
+        numDistinctKeys++;
+      }
+      counts[slot]++;
+    }
+    // offsets: the prefix sum of the counts
+    offsets.resize(control.size() + 1);
+    offsets[0] = 0;
+    for(size_t slot = 0; slot < control.size(); slot++) {
+      offsets[slot + 1] = offsets[slot] + counts[slot];
+    }
+    // fill (using the counts as the next position to write to, for each slot)
+    rowIds.resize(offsets.back());
+    std::copy(offsets.begin(), offsets.end() - 1, counts.begin());
+    for(size_t i = 0; i < size; i++) {
+      if(!isUnmatchable(keys[i])) {
+        rowIds[counts[findSlot(keys[i], mixHash(toHashBits(keys[i])))]++] = i;
+      }
+    }
+  }
+
+  /// the row indices (in the keys of the build) holding a key
+  RowRange lookup(Key const& key) const {
+    if(control.empty() || isUnmatchable(key)) {
+      return {};
+    }
+    auto const slot = findSlot(key, mixHash(toHashBits(key)));
+    if(control[slot] == emptyControl) {
+      return {};
+    }
+    return {rowIds.data() + offsets[slot], rowIds.data() + offsets[slot + 1]};
+  }
+
+  /// the average number of rows holding a key (the expected matches of a key found in the table)
+  double averageRowsPerKey() const {
+    return numDistinctKeys == 0 ? 0.0
+                                : static_cast<double>(rowIds.size()) / (double)numDistinctKeys;
+  }
+
+private:
+  static constexpr size_t groupSize = 16;
+  static constexpr int8_t emptyControl = -128; // NOLINT(readability-magic-numbers): high bit only
+
+  /// the control bytes: emptyControl, or the fingerprint of the key in the slot
+  vector<int8_t> control;
+  vector<Key> slotKeys;
+  /// the rows of the key in slot s are rowIds[offsets[s]] to rowIds[offsets[s + 1] - 1]
+  vector<size_t> offsets;
+  vector<size_t> rowIds;
+  size_t numDistinctKeys = 0;
+  size_t groupMask = 0;
+
+  /// empties the table, with that many groups of slots (a power of two)
+  void resize(size_t numGroups) {
+    groupMask = numGroups - 1;
+    control.assign(numGroups * groupSize, emptyControl);
+    slotKeys.assign(control.size(), Key());
+  }
+
+  /// doubles the number of slots (while counting), moving the keys and their counts
+  void grow(vector<size_t>& counts) {
+    auto oldControl = std::move(control);
+    auto oldKeys = std::move(slotKeys);
+    auto oldCounts = std::move(counts);
+    resize((groupMask + 1) * 2);
+    counts.assign(control.size(), 0);
+    for(size_t oldSlot = 0; oldSlot < oldControl.size(); oldSlot++) {
+      if(oldControl[oldSlot] != emptyControl) {
+        auto const slot = findSlot(oldKeys[oldSlot], mixHash(toHashBits(oldKeys[oldSlot])));
+        control[slot] = oldControl[oldSlot];
+        slotKeys[slot] = oldKeys[oldSlot];
+        counts[slot] = oldCounts[oldSlot];
+      }
+    }
+  }
+
+  static int8_t fingerprint(uint64_t hash) {
+    return static_cast<int8_t>(hash & 0x7f); // NOLINT(readability-magic-numbers)
+  }
+
+  /// the slots of a group whose control byte is `byte` (one bit per slot)
+  uint32_t matchControl(size_t group, int8_t byte) const {
+    auto const* groupControl = control.data() + group * groupSize;
+#ifdef JOINONLY_SSE2
+    auto const bytes = _mm_loadu_si128(reinterpret_cast<__m128i const*>(groupControl));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte))));
+#else
+    uint32_t mask = 0;
+    for(size_t i = 0; i < groupSize; i++) {
+      mask |= static_cast<uint32_t>(groupControl[i] == byte) << i;
+    }
+    return mask;
+#endif
+  }
+
+  /// the slot holding the key, or the empty slot where it would be inserted
+  size_t findSlot(Key const& key, uint64_t hash) const {
+    auto const tag = fingerprint(hash);
+    // (the high bits pick the first group to look into, the low bits are the fingerprint)
+    for(auto group = (hash >> 7) & groupMask;; group = (group + 1) & groupMask) {
+      for(auto mask = matchControl(group, tag); mask != 0; mask &= mask - 1) {
+        auto const slot = group * groupSize + countTrailingZeros(mask);
+        if(slotKeys[slot] == key) {
+          return slot;
+        }
+      }
+      auto const empty = matchControl(group, emptyControl);
+      if(empty != 0) {
+        return group * groupSize + countTrailingZeros(empty);
+      }
+    }
+  }
+};
+using AnyHashTable = std::variant<HashTable<int64_t>, HashTable<double_t>>;
+
+/**
+ * @brief Builds a hash table over typed keys.
+ *
+ * @param keys The join attribute values of the build table.
+ * @param size The number of keys.
+ * @return The hash table, mapping every distinct key to the indices (in keys) holding it.
+ */
+template <typename Key> HashTable<Key> buildHashTable(Key const* keys, size_t size) {
+  return HashTable<Key>(keys, size);
+}
+
+/**
+ * @brief Looks up a key in a hash table built by buildHashTable.
+ *
+ * @return The row indices matching the key (empty if there is none).
+ */
+template <typename Key> RowRange lookup(HashTable<Key> const& hashTable, Key const& probeValue) {
+  return hashTable.lookup(probeValue);
+}
+
+/**
+ * @brief Builds a Bloom filter over the join attribute values of a build table, to reject the
+ * probe keys without a match before looking them up (or partitioning them).
+ */
+template <typename Keys> BloomFilter buildBloomFilter(Keys const& keys) {
+  BloomFilter filter(keys.size());
+  for(auto const& key : keys) {
+    filter.insert(key);
+  }
+  return filter;
+}
+
+/// the radix partitioning aims for partitions of (at most) this many build rows, to stay in cache
+constexpr size_t radixPartitionTargetRows = 2048;
+/// the fan-out of a single partitioning pass is limited to avoid TLB misses when scattering
+constexpr unsigned radixMaxBitsPerPass = 10;
+
+/**
+ * @brief Hashes a key for radix partitioning (multiplicative hashing: use the high bits).
+ *
+ * The hash tables within a partition hash the keys differently (with mixHash), so that all the
+ * keys of a partition do not collide in its hash table.
+ */
+inline uint64_t radixHash(int64_t key) {
+  return static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL; // NOLINT(readability-magic-numbers)
+}
+inline uint64_t radixHash(double_t key) {
+  // (-0.0 and 0.0 are equal but have different bits: toHashBits maps both to the bits of 0.0, so
+  // they are in the same partition)
+  return radixHash(static_cast<int64_t>(toHashBits(key)));
+}
+
+/**
+ * The keys of one side of a join (and an id for each of them), clustered into partitions on the
+ * `bits` high bits of their radix hash. Partition p spans [offsets[p], offsets[p + 1]).
+ */
+template <typename Key> struct RadixPartitions {
+  vector<Key> keys;
+  vector<size_t> ids;
+  vector<size_t> offsets;
+};
+
+/**
+ * @brief Radix-partitions keys (and their ids) into 2^bits partitions, in one or more passes.
+ *
+ * Each pass splits every partition of the previous pass on the next high bits of the hash, with a
+ * histogram, a prefix sum and a scatter (so that each pass writes to a limited number of
+ * locations at once).
+ *
+ * @param keys The keys to partition.
+ * @param ids The ids to keep along with the keys (e.g., the row indices).
+ * @param bits The total number of bits to partition on.
+ * @param passes The maximum number of passes to use.
+ */
+template <typename Key>
+RadixPartitions<Key> radixPartition(vector<Key>&& keys, vector<size_t>&& ids, unsigned bits,
+                                    unsigned passes) {
+  auto const size = keys.size();
+  RadixPartitions<Key> partitions{std::move(keys), std::move(ids), {0, size}};
+  vector<Key> scatteredKeys(size);
+  vector<size_t> scatteredIds(size);
+  unsigned partitionedBits = 0;
+  for(unsigned pass = 0; pass < passes && partitionedBits < bits; pass++) {
+    // spread the remaining bits over the remaining passes
+    unsigned passBits = (bits - partitionedBits + (passes - pass) - 1) / (passes - pass);
+    partitionedBits += passBits;
+    unsigned const shift = 64 - partitionedBits;
+    size_t const fanOut = size_t(1) << passBits;
+    size_t const mask = fanOut - 1;
+    vector<size_t> offsets;
+    offsets.reserve((partitions.offsets.size() - 1) * fanOut + 1);
+    vector<size_t> positions(fanOut);
+    for(size_t p = 0; p + 1 < partitions.offsets.size(); p++) {
+      auto begin = partitions.offsets[p];
+      auto end = partitions.offsets[p + 1];
+      // histogram
+      std::fill(positions.begin(), positions.end(), 0);
+      for(auto i = begin; i < end; i++) {
+        positions[(radixHash(partitions.keys[i]) >> shift) & mask]++;
+      }
+      // prefix sum
+      auto position = begin;
+      for(auto& count : positions) {
+        offsets.push_back(position);
+        position += count;
+        count = offsets.back();
+      }
+      // scatter
+      for(auto i = begin; i < end; i++) {
+        auto& target = positions[(radixHash(partitions.keys[i]) >> shift) & mask];
+        scatteredKeys[target] = partitions.keys[i];
+        scatteredIds[target] = partitions.ids[i];
+        target++;
+      }
+    }
+    offsets.push_back(size);
+    std::swap(partitions.keys, scatteredKeys);
+    std::swap(partitions.ids, scatteredIds);
+    partitions.offsets = std::move(offsets);
+  }
+  return partitions;
+}
+
+/**
+ * @brief The number of bits to radix-partition a build side of `numRows` rows on, so that the
+ * partitions fit in cache.
+ */
+inline unsigned radixPartitionBits(size_t numRows, unsigned passes) {
+  unsigned bits = 0;
+  while(bits < passes * radixMaxBitsPerPass && (numRows >> bits) > radixPartitionTargetRows) {
+    bits++;
+  }
+  return bits;
+}
+
+/**
+ * @brief Joins probe keys with build keys, with a hash table over the build keys.
+ *
+ * @return The matches, as (index in probeKeys, index in buildKeys) pairs.
+ */
+template <typename Key>
+simplificationLayer::StepMatches hashJoinMatches(Key const* buildKeys, size_t buildSize,
+                                                 Key const* probeKeys, size_t probeSize) {
+  simplificationLayer::StepMatches matches;
+  auto const hashTable = buildHashTable(buildKeys, buildSize);
+  for(size_t i = 0; i < probeSize; i++) {
+    for(auto row : lookup(hashTable, probeKeys[i])) {
+      matches.partialIndices.push_back(i);
+      matches.rows.push_back(row);
+    }
+  }
+  return matches;
+}
+
+/**
+ * @brief Joins probe keys with a (large) build column with the radix-partitioned hash join.
+ *
+ * Both the build keys and the probe keys are radix partitioned on the join attribute, and the
+ * partitions are joined pairwise (in parallel) with hash tables small enough to stay in cache.
+ * With a Bloom filter, the probe keys without a match are dropped before they are partitioned.
+ *
+ * @return The matches, as (index in probeKeys, row of buildColumn) pairs.
+ */
+template <typename Key>
+simplificationLayer::StepMatches
+radixPartitionedJoinMatches(simplificationLayer::TypedColumn<Key> const& buildColumn,
+                            vector<Key>&& probeKeys, unsigned passes, bool useBloomFilter,
+                            ThreadPool& threadPool) {
+  vector<size_t> probeIds(probeKeys.size());
+  std::iota(probeIds.begin(), probeIds.end(), 0);
+  if(useBloomFilter) {
+    auto const filter = buildBloomFilter(buildColumn);
+    size_t kept = 0;
+    for(size_t i = 0; i < probeKeys.size(); i++) {
+      if(filter.mayContain(probeKeys[i])) {
+        probeKeys[kept] = probeKeys[i];
+        probeIds[kept++] = i;
+      }
+    }
+    probeKeys.resize(kept);
+    probeIds.resize(kept);
+  }
+  vector<size_t> buildIds(buildColumn.size());
+  std::iota(buildIds.begin(), buildIds.end(), 0);
+  auto const bits = radixPartitionBits(buildColumn.size(), passes);
+  auto const build = radixPartition(vector<Key>(buildColumn.begin(), buildColumn.end()),
+                                    std::move(buildIds), bits, passes);
+  auto const probe = radixPartition(std::move(probeKeys), std::move(probeIds), bits, passes);
+  // each partition writes to its own matches, so that they can be joined in parallel
+  vector<simplificationLayer::StepMatches> partitionMatches(build.offsets.size() - 1);
+  threadPool.parallelFor(partitionMatches.size(), [&](size_t p, size_t /*worker*/) {
+    auto buildBegin = build.offsets[p];
+    auto buildSize = build.offsets[p + 1] - buildBegin;
+    auto probeBegin = probe.offsets[p];
+    auto probeSize = probe.offsets[p + 1] - probeBegin;
+    if(buildSize == 0 || probeSize == 0) {
+      return;
+    }
+    auto& matches = partitionMatches[p];
+    matches = hashJoinMatches(build.keys.data() + buildBegin, buildSize,
+                              probe.keys.data() + probeBegin, probeSize);
+    // back to the ids before partitioning
+    for(size_t m = 0; m < matches.rows.size(); m++) {
+      matches.partialIndices[m] = probe.ids[probeBegin + matches.partialIndices[m]];
+      matches.rows[m] = build.ids[buildBegin + matches.rows[m]];
+    }
+  });
+  return simplificationLayer::concatenate(std::move(partitionMatches));
+}
+
+/**
+ * @brief Joins the inputs with the radix-partitioned hash join.
+ *
+ * This follows the steps of the join order (starting from the rows of the probe table, each step
+ * matches the rows joined so far with one more table), but one step at a time: at each step, the
+ * join attribute of the partial results is radix-partitioned along with the build table.
+ *
+ * @return The result rows, as one vector of row indices per input table.
+ */
+inline simplificationLayer::RowIds
+radixPartitionedJoin(vector<simplificationLayer::Table> const& input,
+                     simplificationLayer::JoinOrder const& order, unsigned passes,
+                     bool useBloomFilters, ThreadPool& threadPool) {
+  // the partial results: rows of the tables joined so far (a vector per table)
+  auto partial = simplificationLayer::allRowsOf(input, order.probeTable);
+  vector<size_t> joinedTables = {order.probeTable};
+  for(auto const& step : order.steps) {
+    simplificationLayer::StepMatches matches;
+    simplificationLayer::visitSameTypeColumns(
+        input[step.table][step.key.column], input[step.probeKey.table][step.probeKey.column],
+        [&](auto const& buildColumn, auto const& probeColumn) {
+          matches = radixPartitionedJoinMatches(
+              buildColumn,
+              simplificationLayer::gatherKeys(probeColumn, partial[step.probeKey.table]), passes,
+              useBloomFilters, threadPool);
+        });
+    // (if the join attributes have different types, nothing matches)
+    partial = simplificationLayer::extendPartialResults(input, step, partial, joinedTables, matches);
+    if(partial[step.table].empty()) {
+      return simplificationLayer::RowIds(input.size());
+    }
+    joinedTables.push_back(step.table);
+  }
+  return partial;
+}
+
+} // namespace boss::engines::joinonly
@@ -1,138 +1,420 @@
 #include "HashJoinOnly.hpp"
 #include "Common.hpp"
 
+#include "Arena.hpp"
+#include "GraceHashJoin.hpp"
+#include "HashJoin.hpp"
+#include "JoinOrder.hpp"
+#include "ScoreBounds.hpp"
+#include "SemiJoinReduction.hpp"
 #include "SimplificationLayer.hpp"
+#include "ThreadPool.hpp"
 #include <Algorithm.hpp>
 #include <Expression.hpp>
 #include <ExpressionUtilities.hpp>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <Utilities.hpp>
 #include <mutex>
+#include <numeric>
 #include <optional>
+#include <thread>
 #include <vector>
 
-namespace boss::engines::joinonly {
+using boss::utilities::operator""_;
+
+namespace boss::engines::joinonly::hashjoinonly {
 using std::vector;
 
+/// one vector of row indices per input table, allocated from an arena
+using ArenaRowIds = std::pmr::vector<std::pmr::vector<size_t>>;
+
 class Engine {
+  /// the number of radix-partitioning passes for large build tables (0 disables partitioning)
+  int64_t radixPartitioningPasses = 1;
+  /// the join is radix-partitioned only if a build table has at least that many rows
+  int64_t radixPartitioningMinRows = int64_t(1) << 16; // NOLINT(readability-magic-numbers)
+  /// the number of probe rows in a morsel (the unit of work of the parallel probe)
+  int64_t morselSize = 16384; // NOLINT(readability-magic-numbers)
+  /// whether to drop the dangling rows of the inputs (with semi-joins) before joining them
+  bool semiJoinReduction = false;
+  /// whether to check Bloom filters (built along with the hash tables) before probing
+  bool bloomFilters = true;
+  /// whether to choose the join order from the data (otherwise, the last table probes backwards)
+  bool joinOrdering = true;
+  /// whether to keep the result rows factorized (one node per distinct row of each table joined)
+  bool factorizedResults = true;
+  /// whether to prune the partial results that cannot pass the selections on scores (or the Top)
+  bool scorePruning = true;
+  /// over this many bytes of hash tables, the join spills to disk (0 for no budget): the budget
+  /// covers the build side only, not the partial results (nor the output)
+  int64_t memoryBudget = 0;
+  /// the workers for the parallel build and probe (the calling thread is one of them)
+  std::unique_ptr<ThreadPool> threadPool =
+      std::make_unique<ThreadPool>(std::max(std::thread::hardware_concurrency(), 1U));
+  /// an arena per worker, for the partial results of the morsel it is probing
+  vector<std::unique_ptr<Arena>> arenas;
+
+  /**
+   * @brief Changes the configuration of the engine, e.g., "Set"_("RadixPartitioningPasses"_, 2).
+   *
+   * @return false if the option is not one of this engine's.
+   */
+  bool setOption(Symbol const& option, int64_t value) {
+    if(option == "RadixPartitioningPasses"_) {
+      radixPartitioningPasses = value;
+      return true;
+    }
+    if(option == "RadixPartitioningMinRows"_) {
+      radixPartitioningMinRows = value;
+      return true;
+    }
+    if(option == "SemiJoinReduction"_) {
+      semiJoinReduction = value != 0;
+      return true;
+    }
+    if(option == "BloomFilters"_) {
+      bloomFilters = value != 0;
+      return true;
+    }
+    if(option == "JoinOrdering"_) {
+      joinOrdering = value != 0;
+      return true;
+    }
+    if(option == "FactorizedResults"_) {
+      factorizedResults = value != 0;
+      return true;
+    }
+    if(option == "ScorePruning"_) {
+      scorePruning = value != 0;
+      return true;
+    }
+    if(option == "MemoryBudget"_) {
+      memoryBudget = std::max<int64_t>(value, 0);
+      return true;
+    }
+    if(option == "MorselSize"_) {
+      morselSize = std::max<int64_t>(value, 1);
+      return true;
+    }
+    if(option == "Threads"_) {
+      threadPool.reset(); // join the current threads first
+      threadPool = std::make_unique<ThreadPool>(std::max<int64_t>(value, 1));
+      return true;
+    }
+    return false;
+  }
+
+  bool useRadixPartitioning(vector<simplificationLayer::Table> const& input,
+                            simplificationLayer::JoinOrder const& order) const {
+    if(radixPartitioningPasses <= 0) {
+      return false;
+    }
+    return std::any_of(order.steps.begin(), order.steps.end(), [&](auto const& step) {
+      return simplificationLayer::getNumRows(input[step.table]) >= (size_t)radixPartitioningMinRows;
+    });
+  }
+
+  /**
+   * @brief Probes the hash tables level by level, keeping the result rows factorized: a level per
+   * step, with a node per distinct matching row of its table (the matches of a row only depend on
+   * its key, so each row is looked up once, however many partial results it is part of).
+   *
+   * The lookups of each level run in parallel, over morsels of the nodes of its parent level.
+   * The predicates closing cycles need the whole result rows: they are not supported here.
+   */
+  simplificationLayer::FactorizedRowIds
+  factorizedProbe(vector<simplificationLayer::Table> const& input,
+                  simplificationLayer::JoinOrder const& order,
+                  vector<AnyHashTable> const& hashTables, vector<BloomFilter> const& filters,
+                  vector<size_t>&& probeRows) {
+    simplificationLayer::FactorizedRowIds factorized;
+    factorized.levels.push_back({order.probeTable, 0, std::move(probeRows), {}, {}});
+    vector<size_t> levelOf(input.size());
+    levelOf[order.probeTable] = 0;
+    auto const rowsPerMorsel = static_cast<size_t>(morselSize);
+    for(size_t k = 0; k < order.steps.size(); k++) {
+      auto const& step = order.steps[k];
+      auto const parentLevel = levelOf[step.probeKey.table];
+      auto const& parentRows = factorized.levels[parentLevel].rows;
+      auto const* filter = k > 0 && !filters.empty() ? &filters[k] : nullptr;
+      // the matches of each node of the parent level (ranges of the rows in the hash table)
+      vector<RowRange> matches(parentRows.size());
+      std::visit(
+          [&](auto const& hashTable, auto const& probeKeys) {
+            using Key = typename std::decay_t<decltype(probeKeys)>::value_type;
+            if constexpr(std::is_same_v<std::decay_t<decltype(hashTable)>, HashTable<Key>>) {
+              auto const numMorsels = (parentRows.size() + rowsPerMorsel - 1) / rowsPerMorsel;
+              threadPool->parallelFor(numMorsels, [&](size_t morsel, size_t /*worker*/) {
+                auto const end = std::min(parentRows.size(), (morsel + 1) * rowsPerMorsel);
+                for(auto node = morsel * rowsPerMorsel; node < end; node++) {
+                  auto const& probeKey = probeKeys[parentRows[node]];
+                  if(filter == nullptr || filter->mayContain(probeKey)) {
+                    matches[node] = lookup(hashTable, probeKey);
+                  }
+                }
+              });
+            }
+            // otherwise, the key types differ: values of different types never match
+          },
+          hashTables[k], input[step.probeKey.table][step.probeKey.column]);
+      // a node per distinct matching row (their children are the same wherever they appear)
+      simplificationLayer::FactorizedRowIds::Level level{step.table, parentLevel, {}, {}, {}};
+      level.offsets.reserve(parentRows.size() + 1);
+      level.offsets.push_back(0);
+      auto const none = std::numeric_limits<size_t>::max();
+      vector<size_t> nodeOf(simplificationLayer::getNumRows(input[step.table]), none);
+      for(auto const& range : matches) {
+        for(auto row : range) {
+          if(nodeOf[row] == none) {
+            nodeOf[row] = level.rows.size();
+            level.rows.push_back(row);
+          }
+          level.children.push_back(nodeOf[row]);
+        }
+        level.offsets.push_back(level.children.size());
+      }
+      levelOf[step.table] = factorized.levels.size();
+      factorized.levels.push_back(std::move(level));
+    }
+    return factorized;
+  }
+
+  /**
+   * @brief Extends the probe rows depth-first, one step at a time, pruning the partial results
+   * whose scores cannot pass the selections on scores or enter the top rows (branch-and-bound).
+   */
+  simplificationLayer::RowIds boundedProbe(vector<simplificationLayer::Table> const& input,
+                                           simplificationLayer::JoinOrder const& order,
+                                           vector<AnyHashTable> const& hashTables,
+                                           vector<BloomFilter> const& filters,
+                                           vector<size_t> const& probeRows,
+                                           simplificationLayer::ScoreBounds& bounds) {
+    auto const& steps = order.steps;
+    auto const numScores = bounds.numScores();
+    simplificationLayer::RowIds output(input.size());
+    vector<double> topScoresOfOutput;
+    // the rows of the current partial result (a single one per table)
+    simplificationLayer::RowIds current(input.size(), vector<size_t>(1));
+    // the sums of its scores, after each step
+    vector<double> sums((steps.size() + 1) * numScores, 0);
+    std::function<void(size_t)> extendFrom = [&](size_t k) {
+      auto const* stepSums = sums.data() + k * numScores;
+      if(k == steps.size()) {
+        if(bounds.keep(stepSums)) {
+          for(size_t t = 0; t < input.size(); t++) {
+            output[t].push_back(current[t][0]);
+          }
+          topScoresOfOutput.push_back(bounds.topScoreOf(stepSums));
+        }
+        return;
+      }
+      if(!bounds.mayQualify(k + 1, stepSums)) {
+        return; // no table joined next can make up for it
+      }
+      auto const& step = steps[k];
+      auto const* filter = k > 0 && !filters.empty() ? &filters[k] : nullptr;
+      std::visit(
+          [&](auto const& hashTable, auto const& probeKeys) {
+            using Key = typename std::decay_t<decltype(probeKeys)>::value_type;
+            if constexpr(std::is_same_v<std::decay_t<decltype(hashTable)>, HashTable<Key>>) {
+              auto const& probeKey = probeKeys[current[step.probeKey.table][0]];
+              if(filter != nullptr && !filter->mayContain(probeKey)) {
+                return;
+              }
+              for(auto match : lookup(hashTable, probeKey)) {
+                if(!simplificationLayer::cyclicPredicatesHold(step.cyclicPredicates, input,
+                                                              step.table, match, current, 0)) {
+                  continue;
+                }
+                current[step.table][0] = match;
+                bounds.addTerms(step.table, match, stepSums, sums.data() + (k + 1) * numScores);
+                extendFrom(k + 1);
+              }
+            }
+          },
+          hashTables[k], input[step.probeKey.table][step.probeKey.column]);
+    };
+    vector<double> noScores(numScores, 0);
+    for(auto row : probeRows) {
+      current[order.probeTable][0] = row;
+      bounds.addTerms(order.probeTable, row, noScores.data(), sums.data());
+      extendFrom(0);
+    }
+    // drop the rows that were in the top rows when found, but were pushed out of them since
+    simplificationLayer::RowIds top(input.size());
+    for(size_t r = 0; r < topScoresOfOutput.size(); r++) {
+      if(bounds.inFinalTop(topScoresOfOutput[r])) {
+        for(size_t t = 0; t < input.size(); t++) {
+          top[t].push_back(output[t][r]);
+        }
+      }
+    }
+    return top;
+  }
+
   simplificationLayer::JoinHelper performMultiwayJoin(simplificationLayer::JoinHelper&& helper) {
 
     ////////////////////////////////////////////////////////////////////////////////
     ///////////////////////////// Your code starts here ////////////////////////////
     ////////////////////////////////////////////////////////////////////////////////
 
+    if(semiJoinReduction) {
+      simplificationLayer::semiJoinReduce(helper);
+    }
     auto const& input = helper.getInputs();
-    auto const& joinAttributeIndices = helper.getJoinAttributeIndices();
-
-    std::hash<simplificationLayer::Value> const valueHash;
-    // First in pair is the value, second is vector of index
-    vector<vector<std::pair<std::optional<simplificationLayer::Value>, vector<size_t>>>> hashTables(
-      joinAttributeIndices.size());
-    int nextSlot;
-
-    // First, we Build!!
-    for (int c = 0; c < joinAttributeIndices.size(); c++) {
-      hashTables[c] = vector<std::pair<std::optional<simplificationLayer::Value>, vector<size_t>>>(
-        input[c][0].size() * 2);
-      for (int i = 0; i < input[c][0].size(); i++) {
-
-        auto buildValue = input[c][joinAttributeIndices[c].first][i];
-        size_t hash = valueHash(buildValue) % hashTables[c].size();
-        // Handle repeats
-        while (hashTables[c][hash].first.has_value() && hashTables[c][hash].first.value() != buildValue)
-          hash = (hash + 1) % hashTables[c].size();
-        hashTables[c][hash].first = buildValue;
-        hashTables[c][hash].second.push_back(i);
-        if (hashTables[c][hash].second.size() > 1)
-        {
-          // We have a repeat!
-          int unusedvar = 0; // used for testing
-        }
+
+    // Choose the probe table and the order of the steps (each step builds on one more table)
+    // The predicates closing cycles are checked as soon as all their rows are matched
+    auto const order = joinOrdering ? simplificationLayer::optimizeJoinOrder(helper)
+                                    : simplificationLayer::backwardJoinOrder(helper);
+
+    // Hash tables that would not fit in the memory budget: switch to the grace hash join
+    if(memoryBudget > 0 &&
+       estimateHashTablesBytes(input, order) > static_cast<double>(memoryBudget)) {
+      helper.appendOutputRowIds(graceHashJoin(input, order, static_cast<size_t>(memoryBudget)));
+      return std::move(helper);
+    }
+
+    // With selections on scores (or a Top) above the join, the partial results are pruned early
+    simplificationLayer::ScoreBounds bounds(input, order, helper.getScoreThresholds(),
+                                            helper.getTopScores());
+    auto const pruneOnScores = scorePruning && bounds.enabled();
+
+    // Large build tables do not fit in cache: switch to the radix-partitioned join
+    if(!pruneOnScores && useRadixPartitioning(input, order)) {
+      helper.appendOutputRowIds(
+          radixPartitionedJoin(input, order, radixPartitioningPasses, bloomFilters, *threadPool));
+      return std::move(helper);
+    }
+
+    // First, we Build!! (one hash table per step, typed on the key column of its table)
+    // (the hash tables are independent: they are built in parallel, with their Bloom filters)
+    auto const& steps = order.steps;
+    vector<AnyHashTable> hashTables(steps.size());
+    vector<BloomFilter> filters(bloomFilters ? steps.size() : 0);
+    threadPool->parallelFor(steps.size(), [&](size_t k, size_t /*worker*/) {
+      auto const& keyColumn = input[steps[k].table][steps[k].key.column];
+      hashTables[k] = std::visit(
+          [](auto const& keys) -> AnyHashTable { return buildHashTable(keys.data(), keys.size()); },
+          keyColumn);
+      if(bloomFilters) {
+        filters[k] = std::visit([](auto const& keys) { return buildBloomFilter(keys); }, keyColumn);
       }
+    });
+
+    // The probe rows without a match in the first hash table are dropped up-front (with its filter)
+    vector<size_t> probeRows(simplificationLayer::getNumRows(input[order.probeTable]));
+    std::iota(probeRows.begin(), probeRows.end(), 0);
+    if(!filters.empty()) {
+      std::visit(
+          [&](auto const& probeKeys) {
+            probeRows.erase(std::remove_if(probeRows.begin(), probeRows.end(),
+                                           [&](auto row) {
+                                             return !filters.front().mayContain(probeKeys[row]);
+                                           }),
+                            probeRows.end());
+          },
+          input[order.probeTable][steps.front().probeKey.column]);
     }
 
-    auto &probeTable = input[input.size()-1];
-    for (int i = 0; i < probeTable[0].size(); i++)
-    {
-      // Each row in the probe table
-
-      /**
-       * This data object contains the values of the join.
-       * [[[4,1,0],[3,2,0]], [[1,0],[2,0]], [[0]]]
-       * Implies that we have a join on cursors 4,1,0 and 3,2,0
-       */
-      vector<vector<vector<size_t>>> indexes(input.size(), vector<vector<size_t>>(0, vector<size_t>(0))); // Indexes of the join
-      indexes[input.size()-1].emplace_back(0);
-      indexes[input.size()-1][0].push_back(i); // Index of last table is i
-
-      for (int j = hashTables.size() - 1; j >= 0; j--) {
-        // For each hashtable, backwards
-        vector<int> curIndexes;
-        for (int k = 0; k < indexes[j+1].size(); k++) {
-          // For each index of the hashtable ahead
-          vector<size_t> index = indexes[j+1][k];
-          auto val = input[j+1][joinAttributeIndices[j].second][index[0]];
-          int hash = valueHash(val) % hashTables[j].size();
-
-          // handle clashes
-          while (hashTables[j][hash].first.has_value() && hashTables[j][hash].first.value() != val)
-            hash = (hash + 1) % hashTables[j].size();
-        
-          if (hashTables[j][hash].first.has_value() && hashTables[j][hash].first.value() == val) {
-            // Add to indexes
-            for (int l = 0; l < hashTables[j][hash].second.size(); l++) {
-              // This new index is the details of the last index, with the addition of the current
-              // found mapping. This is O(n), and can be inefficient with longer join chains.
-              // We have opted for code readability instead of this slight code improvement, meaning
-              // we dont have to work backwards.
-              // In addition, some compilers on some architectures can optimise this, to have the vector
-              // point to the next vector.
-              vector<size_t> newIndex;
-              newIndex.push_back(hashTables[j][hash].second[l]);
-              for (auto ind: index)
-              {
-                newIndex.push_back(ind);
-              }
+    if(pruneOnScores) {
+      helper.appendOutputRowIds(
+          boundedProbe(input, order, hashTables, filters, probeRows, bounds));
+      return std::move(helper);
+    }
 
-              indexes[j].push_back(newIndex);
-            }
-          }
+    // Without cycles to close, the result rows are kept factorized (flattened by getResult())
+    if(factorizedResults && helper.getCyclicPredicates().empty()) {
+      helper.appendFactorizedOutputRowIds(
+          factorizedProbe(input, order, hashTables, filters, std::move(probeRows)));
+      return std::move(helper);
+    }
+
+    // Then, we Probe!! The probe rows are split into morsels, processed in parallel by the workers.
+    // Each morsel has its own output buffer (the result rows, as one vector of row indices per
+    // input table), merged in order at the end so that the output does not depend on scheduling.
+    auto const numProbeRows = probeRows.size();
+    auto const rowsPerMorsel = static_cast<size_t>(morselSize);
+    vector<simplificationLayer::RowIds> morselOutputs((numProbeRows + rowsPerMorsel - 1) /
+                                                      rowsPerMorsel);
+    while(arenas.size() < threadPool->size()) {
+      arenas.push_back(std::make_unique<Arena>());
+    }
+    threadPool->parallelFor(morselOutputs.size(), [&](size_t morsel, size_t worker) {
+      // the partial results of the morsel: rows of the tables joined so far (a vector per table)
+      // (allocated from the arena of the worker, freed all at once for the next morsel)
+      auto& arena = *arenas[worker];
+      arena.reset();
+      ArenaRowIds partial(input.size(), &arena);
+      partial[order.probeTable].assign(
+          probeRows.begin() + morsel * rowsPerMorsel,
+          probeRows.begin() + std::min(numProbeRows, (morsel + 1) * rowsPerMorsel));
+      vector<size_t> joinedTables = {order.probeTable};
+      for(size_t k = 0; k < steps.size() && !partial[joinedTables.back()].empty(); k++) {
+        // For each hashtable, in the join order
+        // (dispatching on the key types once per step, so that the lookups are type-specialized)
+        // (the first hash table's filter was already checked when selecting the probe rows)
+        auto const& step = steps[k];
+        auto const* filter = k > 0 && !filters.empty() ? &filters[k] : nullptr;
+        // (reserved for the expected matches: the buffers outgrown would stay in the arena)
+        auto const expectedRows = static_cast<size_t>(
+            std::visit([](auto const& hashTable) { return hashTable.averageRowsPerKey(); },
+                       hashTables[k]) *
+            (double)partial[joinedTables.front()].size());
+        ArenaRowIds next(input.size(), &arena);
+        for(auto t : joinedTables) {
+          next[t].reserve(expectedRows);
         }
+        next[step.table].reserve(expectedRows);
+        std::visit(
+            [&](auto const& hashTable, auto const& probeKeys) {
+              using Key = typename std::decay_t<decltype(probeKeys)>::value_type;
+              if constexpr(std::is_same_v<std::decay_t<decltype(hashTable)>, HashTable<Key>>) {
+                auto const& probeKeyRows = partial[step.probeKey.table];
+                for(size_t index = 0; index < probeKeyRows.size(); index++) {
+                  auto const& probeKey = probeKeys[probeKeyRows[index]];
+                  if(filter != nullptr && !filter->mayContain(probeKey)) {
+                    continue; // no match (a single memory access to find out)
+                  }
+                  for(auto match : lookup(hashTable, probeKey)) {
+                    if(!simplificationLayer::cyclicPredicatesHold(step.cyclicPredicates, input,
+                                                                  step.table, match, partial,
+                                                                  index)) {
+                      continue; // a cycle is not closed
+                    }
+                    // extend the partial result with the matching row of this table
+                    next[step.table].push_back(match);
+                    for(auto t : joinedTables) {
+                      next[t].push_back(partial[t][index]);
+                    }
+                  }
+                }
+              }
+              // otherwise, the key types differ: values of different types never match
+            },
+            hashTables[k], input[step.probeKey.table][step.probeKey.column]);
+        partial = std::move(next);
+        joinedTables.push_back(step.table);
       }
-
-      // Return result of indexes!
-
-      /**
-       * Implimentation detail:
-       * This can be moved to inside of the probing function, on the last backward
-       * join attribute iteration. This also includes making the indexes object only have a size of 2;
-       * [0] being the current iteration, and
-       * [1] being the iteration before.
-       *
-       * However, the increased memory cost means we dont have to do memory moving, and we obtain
-       * data that can be used to optimise further queries in a more complex system.
-       *
-       * Lastly, this provides a seperation for more fine grained threading details, if the need arises.
-       */
-      for (auto ind: indexes[0])
-      {
-        // populate resultTuple
-        vector<simplificationLayer::Value> resultTuple;
-
-        for (int j = 0; j < ind.size(); j++) {
-          // for each index
-          // for each col in table
-          for (int k = 0; k < input[j].size(); k++) {
-            // push value
-            resultTuple.push_back(input[j][k][ind[j]]);
-          }
+      if(joinedTables.size() == input.size()) {
+        // only record the rows (the values are gathered in bulk by the helper)
+        morselOutputs[morsel].resize(input.size());
+        for(size_t t = 0; t < input.size(); t++) {
+          morselOutputs[morsel][t].assign(partial[t].begin(), partial[t].end());
         }
-
-        // Append!
-        helper.appendOutput(resultTuple);
+      } else {
+        morselOutputs[morsel].resize(input.size()); // stopped early: no result
       }
+    });
+    for(auto& arena : arenas) {
+      arena->reset(); // (down to the blocks it retains, until the next join)
     }
 
+    // Append!
+    helper.appendOutputRowIds(simplificationLayer::mergeRowIds(std::move(morselOutputs), input.size()));
+
     ////////////////////////////////////////////////////////////////////////////////
     ////////////////////////////// Your code ends here /////////////////////////////
     ////////////////////////////////////////////////////////////////////////////////
@@ -144,7 +426,14 @@ public:
     try {
       return visit(boss::utilities::overload(
                        [this](ComplexExpression&& e) -> Expression {
-                         if(e.getHead().getName() == "Join") {
+                         auto const& args = e.getDynamicArguments();
+                         if(e.getHead() == "Set"_ && args.size() == 2 &&
+                            std::holds_alternative<Symbol>(args[0]) &&
+                            std::holds_alternative<int64_t>(args[1]) &&
+                            setOption(get<Symbol>(args[0]), get<int64_t>(args[1]))) {
+                           return true;
+                         }
+                         if(simplificationLayer::JoinHelper::isJoinPlan(e)) {
                            return performMultiwayJoin(simplificationLayer::JoinHelper(std::move(e)))
                                .getResult();
                          } else {
@@ -170,12 +459,14 @@ public:
   }
 };
 
-} // namespace boss::engines::joinonly
+} // namespace boss::engines::joinonly::hashjoinonly
+
+using boss::engines::joinonly::hashjoinonly::Engine;
 
 static auto& enginePtr(bool initialise = true) {
-  static auto engine = std::unique_ptr<boss::engines::joinonly::Engine>();
+  static auto engine = std::unique_ptr<Engine>();
   if(!engine && initialise) {
-    engine.reset(new boss::engines::joinonly::Engine());
+    engine.reset(new Engine());
   }
   return engine;
 }
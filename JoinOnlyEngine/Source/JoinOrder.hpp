@@ -0,0 +1,322 @@
+#pragma once
+
+#include "SimplificationLayer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace simplificationLayer {
+
+/**
+ * A binary step of a join chain: the rows joined so far are extended with the matching rows of
+ * one more table (looked up on its join attribute, e.g., in a hash table built over it).
+ */
+struct JoinStep {
+  /// the table joined at this step (the build side)
+  size_t table;
+  /// the join attribute of that table
+  Attribute key;
+  /// the attribute it is joined with, in a table joined at an earlier step (the probe side)
+  Attribute probeKey;
+  /// the predicates closing cycles that can be checked once this table is joined
+  std::vector<CyclicPredicate> cyclicPredicates;
+};
+
+/**
+ * The order in which to join the tables of a chain: starting from all the rows of the probe
+ * table, each step joins a table adjacent to the ones joined so far.
+ *
+ * The order only affects the cost of the join: the result rows are still given as one vector of
+ * row indices per input table, so the output columns are in the order of the plan.
+ */
+struct JoinOrder {
+  size_t probeTable = 0;
+  std::vector<JoinStep> steps;
+};
+
+/// the number of rows to sample to estimate the number of distinct values of a column
+constexpr size_t distinctCountSampleSize = 1024;
+
+/**
+ * @brief Estimates the number of distinct values of a column.
+ *
+ * Small columns are counted exactly. For larger ones, a (deterministic) random sample is counted
+ * and scaled with the GEE estimator (Charikar et al.): the values seen once in the sample stand for
+ * sqrt(n / sampleSize) distinct values each, the others for one.
+ *
+ * @param values The values (e.g., a typed column, or the keys of partial results).
+ */
+template <typename Values> double estimateDistinctCount(Values const& values) {
+  using T = std::decay_t<decltype(values[0])>;
+  auto const size = values.size();
+  std::unordered_map<T, size_t> frequencies;
+  if(size <= 4 * distinctCountSampleSize) {
+    for(size_t i = 0; i < size; i++) {
+      frequencies[values[i]]++;
+    }
+    return static_cast<double>(frequencies.size());
+  }
+  std::mt19937_64 random(size);
+  std::uniform_int_distribution<size_t> rows(0, size - 1);
+  for(size_t i = 0; i < distinctCountSampleSize; i++) {
+    frequencies[values[rows(random)]]++;
+  }
+  double seenOnce = 0;
+  double seenMore = 0;
+  for(auto const& [value, frequency] : frequencies) {
+    (frequency == 1 ? seenOnce : seenMore) += 1;
+  }
+  auto const estimate =
+      std::sqrt(static_cast<double>(size) / distinctCountSampleSize) * seenOnce + seenMore;
+  return std::min(estimate, static_cast<double>(size));
+}
+inline double estimateDistinctCount(Column const& column) {
+  return std::visit([](auto const& values) { return estimateDistinctCount(values); }, column);
+}
+
+namespace detail {
+/// assigns each predicate closing a cycle to the step after which both of its tables are joined
+inline void assignCyclicPredicates(JoinOrder& order,
+                                   std::vector<CyclicPredicate> const& cyclicPredicates,
+                                   size_t numTables) {
+  std::vector<size_t> position(numTables, 0); // the probe table is at position 0
+  for(size_t k = 0; k < order.steps.size(); k++) {
+    position[order.steps[k].table] = k + 1;
+  }
+  for(auto const& predicate : cyclicPredicates) {
+    auto const last = std::max(position[predicate.first.table], position[predicate.second.table]);
+    order.steps[last - 1].cyclicPredicates.push_back(predicate);
+  }
+}
+
+/// the step joining table `table` to the adjacent table joined before it
+inline JoinStep stepJoining(size_t table, bool fromTheRight,
+                            std::vector<std::pair<size_t, size_t>> const& joinAttributeIndices) {
+  if(fromTheRight) { // joined with table + 1, on joinAttributeIndices[table]
+    return {table,
+            {table, joinAttributeIndices[table].first},
+            {table + 1, joinAttributeIndices[table].second},
+            {}};
+  }
+  // joined with table - 1, on joinAttributeIndices[table - 1]
+  return {table,
+          {table, joinAttributeIndices[table - 1].second},
+          {table - 1, joinAttributeIndices[table - 1].first},
+          {}};
+}
+} // namespace detail
+
+/**
+ * @brief The order of the plan: the last table probes into the one before it, whose matches probe
+ * into the one before, and so on.
+ */
+inline JoinOrder backwardJoinOrder(JoinHelper& helper) {
+  auto const& joinAttributeIndices = helper.getJoinAttributeIndices();
+  auto const numTables = helper.getInputs().size();
+  JoinOrder order;
+  if(numTables == 0) {
+    return order;
+  }
+  order.probeTable = numTables - 1;
+  for(size_t table = numTables - 1; table-- > 0;) {
+    order.steps.push_back(detail::stepJoining(table, true, joinAttributeIndices));
+  }
+  detail::assignCyclicPredicates(order, helper.getCyclicPredicates(), numTables);
+  return order;
+}
+
+/**
+ * @brief Chooses the probe table and the order of the binary steps of a join chain from the
+ * cardinalities of the inputs and the (estimated) number of distinct values of their join
+ * attributes.
+ *
+ * The joined tables always form a contiguous range [l, r] of the chain (so that each step has a
+ * join predicate), whose size is estimated as the product of the cardinalities divided, for each
+ * join predicate in the range, by the larger of the distinct counts of its two sides. The cost of
+ * an order is the number of build rows (weighted twice, for the hash tables) plus probe rows plus
+ * the sizes of all the intermediate results: the cheapest order is found with a dynamic program
+ * over the ranges. Ties are broken in favour of the order of the plan.
+ *
+ * The predicates closing cycles are checked as early as possible, but are not accounted for in
+ * the estimates.
+ */
+inline JoinOrder optimizeJoinOrder(JoinHelper& helper) {
+  auto const& inputs = helper.getInputs();
+  auto const& joinAttributeIndices = helper.getJoinAttributeIndices();
+  auto const numTables = inputs.size();
+  if(numTables == 0) {
+    return {};
+  }
+  std::vector<double> cardinalities(numTables);
+  for(size_t t = 0; t < numTables; t++) {
+    cardinalities[t] = static_cast<double>(getNumRows(inputs[t]));
+  }
+  // the selectivity of the join predicate between tables e and e + 1
+  std::vector<double> selectivities(joinAttributeIndices.size());
+  for(size_t e = 0; e < joinAttributeIndices.size(); e++) {
+    auto const distinct =
+        std::max({estimateDistinctCount(inputs[e][joinAttributeIndices[e].first]),
+                  estimateDistinctCount(inputs[e + 1][joinAttributeIndices[e].second]), 1.0});
+    selectivities[e] = 1.0 / distinct;
+  }
+  double totalRows = 0;
+  for(auto cardinality : cardinalities) {
+    totalRows += cardinality;
+  }
+  // cost[l][r]: the cheapest way to join the tables l to r (and the last table it joined)
+  std::vector<std::vector<double>> cost(numTables, std::vector<double>(numTables));
+  std::vector<std::vector<bool>> joinedLeftmostLast(numTables, std::vector<bool>(numTables));
+  for(size_t t = 0; t < numTables; t++) {
+    cost[t][t] = 2 * (totalRows - cardinalities[t]) + cardinalities[t];
+  }
+  for(size_t length = 2; length <= numTables; length++) {
+    for(size_t l = 0; l + length <= numTables; l++) {
+      auto const r = l + length - 1;
+      double size = cardinalities[l];
+      for(size_t t = l + 1; t <= r; t++) {
+        size *= cardinalities[t] * selectivities[t - 1];
+      }
+      joinedLeftmostLast[l][r] = cost[l + 1][r] <= cost[l][r - 1];
+      cost[l][r] = size + std::min(cost[l + 1][r], cost[l][r - 1]);
+    }
+  }
+  // follow the choices back from the whole chain to the probe table
+  JoinOrder order;
+  size_t l = 0;
+  size_t r = numTables - 1;
+  while(l < r) {
+    if(joinedLeftmostLast[l][r]) {
+      order.steps.push_back(detail::stepJoining(l++, true, joinAttributeIndices));
+    } else {
+      order.steps.push_back(detail::stepJoining(r--, false, joinAttributeIndices));
+    }
+  }
+  order.probeTable = l;
+  std::reverse(order.steps.begin(), order.steps.end());
+  detail::assignCyclicPredicates(order, helper.getCyclicPredicates(), numTables);
+  return order;
+}
+
+/**
+ * @brief Checks the predicates closing cycles for a candidate result row: the row `row` of table
+ * `table` extending the partial result `partialIndex` (whose rows are in `partial`, one vector of
+ * row indices per table, as RowIds or allocated elsewhere).
+ */
+template <typename PartialRowIds>
+bool cyclicPredicatesHold(std::vector<CyclicPredicate> const& cyclicPredicates,
+                          std::vector<Table> const& input, size_t table, size_t row,
+                          PartialRowIds const& partial, size_t partialIndex) {
+  auto rowOf = [&](Attribute const& attribute) {
+    return attribute.table == table ? row : partial[attribute.table][partialIndex];
+  };
+  return std::all_of(cyclicPredicates.begin(), cyclicPredicates.end(), [&](auto const& predicate) {
+    auto const& [lhs, rhs] = predicate;
+    return valuesEqual(input[lhs.table][lhs.column], rowOf(lhs), input[rhs.table][rhs.column],
+                       rowOf(rhs));
+  });
+}
+
+/// the initial partial results of a join: all the rows of its probe table
+inline RowIds allRowsOf(std::vector<Table> const& input, size_t table) {
+  RowIds partial(input.size());
+  partial[table].resize(getNumRows(input[table]));
+  std::iota(partial[table].begin(), partial[table].end(), 0);
+  return partial;
+}
+
+/**
+ * @brief Concatenates the row indices of several partial outputs, in order.
+ */
+inline RowIds mergeRowIds(std::vector<RowIds>&& outputs, size_t numTables) {
+  RowIds merged(numTables);
+  for(size_t t = 0; t < numTables; t++) {
+    size_t numRows = 0;
+    for(auto const& output : outputs) {
+      numRows += output[t].size();
+    }
+    merged[t].reserve(numRows);
+    for(auto& output : outputs) {
+      merged[t].insert(merged[t].end(), output[t].begin(), output[t].end());
+      std::vector<size_t>().swap(output[t]);
+    }
+  }
+  return merged;
+}
+
+/**
+ * The matches found by a join step (by whichever algorithm): the partial result partialIndices[m]
+ * matches the row rows[m] of the table joined at that step.
+ */
+struct StepMatches {
+  std::vector<size_t> partialIndices;
+  std::vector<size_t> rows;
+};
+
+/// concatenates the matches of several parts of a join step (e.g., partitions), in order
+inline StepMatches concatenate(std::vector<StepMatches>&& parts) {
+  StepMatches all;
+  size_t numMatches = 0;
+  for(auto const& part : parts) {
+    numMatches += part.rows.size();
+  }
+  all.partialIndices.reserve(numMatches);
+  all.rows.reserve(numMatches);
+  for(auto& part : parts) {
+    all.partialIndices.insert(all.partialIndices.end(), part.partialIndices.begin(),
+                              part.partialIndices.end());
+    all.rows.insert(all.rows.end(), part.rows.begin(), part.rows.end());
+    part = StepMatches();
+  }
+  return all;
+}
+
+/// the values of a column at the given rows (e.g., the join attribute of the partial results)
+template <typename Key>
+std::vector<Key> gatherKeys(TypedColumn<Key> const& column, std::vector<size_t> const& rows) {
+  std::vector<Key> keys(rows.size());
+  for(size_t i = 0; i < rows.size(); i++) {
+    keys[i] = column[rows[i]];
+  }
+  return keys;
+}
+
+/**
+ * @brief Appends to the next partial results the matches of (part of) a join step that close the
+ * cycles checked at that step.
+ *
+ * @param joinedTables The tables joined before this step (the others have no rows in partial).
+ */
+inline void appendPartialResults(std::vector<Table> const& input, JoinStep const& step,
+                                 RowIds const& partial, std::vector<size_t> const& joinedTables,
+                                 StepMatches const& matches, RowIds& next) {
+  for(size_t m = 0; m < matches.rows.size(); m++) {
+    auto const index = matches.partialIndices[m];
+    auto const row = matches.rows[m];
+    if(!cyclicPredicatesHold(step.cyclicPredicates, input, step.table, row, partial, index)) {
+      continue;
+    }
+    next[step.table].push_back(row);
+    for(auto t : joinedTables) {
+      next[t].push_back(partial[t][index]);
+    }
+  }
+}
+
+/**
+ * @brief Extends the partial results with the matches of a join step (those that close the cycles
+ * checked at that step).
+ *
+ * @param joinedTables The tables joined before this step (the others have no rows in partial).
+ */
+inline RowIds extendPartialResults(std::vector<Table> const& input, JoinStep const& step,
+                                   RowIds const& partial, std::vector<size_t> const& joinedTables,
+                                   StepMatches const& matches) {
+  RowIds next(input.size());
+  appendPartialResults(input, step, partial, joinedTables, matches, next);
+  return next;
+}
+
+} // namespace simplificationLayer
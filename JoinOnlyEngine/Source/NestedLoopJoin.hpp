@@ -0,0 +1,143 @@
+#pragma once
+
+#include "JoinOrder.hpp"
+#include "Simd.hpp"
+#include "SimplificationLayer.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace boss::engines::joinonly {
+using std::vector;
+
+/// the number of rows of a table compared at once with the partial results (a bit each in a mask)
+constexpr size_t blockRows = 64;
+/// the number of partial results compared with each block of rows (their keys stay in L1)
+constexpr size_t batchRows = 256;
+
+/**
+ * @brief Compares a batch of keys with all the keys of a column, tiled so that the comparisons
+ * run from L1: the column is scanned one block of 64 rows at a time, and the keys of the block
+ * are compared with each key of the batch with SIMD instructions, giving a mask of the matching
+ * rows.
+ *
+ * @param onMatch Called with (index in keys, row of the column) for each pair of equal keys, block
+ * by block (and, within a block, key by key).
+ */
+template <typename Key, typename OnMatch>
+void forEachBlockMatch(Key const* keys, size_t numKeys,
+                       simplificationLayer::TypedColumn<Key> const& column, OnMatch&& onMatch) {
+  for(size_t begin = 0; begin < column.size(); begin += blockRows) {
+    auto const size = std::min(blockRows, column.size() - begin);
+    for(size_t k = 0; k < numKeys; k++) {
+      for(auto mask = equalMask(column.data() + begin, size, keys[k]); mask != 0;
+          mask &= mask - 1) {
+        onMatch(k, begin + countTrailingZeros(mask));
+      }
+    }
+  }
+}
+
+/**
+ * @brief Joins probe keys with a build column with the block nested-loop join (no set-up cost at
+ * all): the probe keys are compared in batches with each block of the column.
+ *
+ * @return The matches, as (index in probeKeys, row of buildColumn) pairs.
+ */
+template <typename Key>
+simplificationLayer::StepMatches
+nestedLoopJoinMatches(simplificationLayer::TypedColumn<Key> const& buildColumn,
+                      vector<Key> const& probeKeys) {
+  simplificationLayer::StepMatches matches;
+  for(size_t begin = 0; begin < probeKeys.size(); begin += batchRows) {
+    forEachBlockMatch(probeKeys.data() + begin, std::min(batchRows, probeKeys.size() - begin),
+                      buildColumn, [&](size_t k, size_t row) {
+                        matches.partialIndices.push_back(begin + k);
+                        matches.rows.push_back(row);
+                      });
+  }
+  return matches;
+}
+
+/**
+ * The block nested-loop join: the same comparisons as the nested-loop join, but tiled so that
+ * they run from L1.
+ *
+ * The partial results (rows of the tables 0 to i - 1 that match so far) are processed in batches.
+ * Each batch is compared with table i one block of 64 rows at a time (see forEachBlockMatch). Only
+ * the matching rows (if any) extend the partial results, which are passed on to table i + 1
+ * whenever they fill a batch: the iteration recurses only on matching blocks.
+ */
+class BlockNestedLoopJoin {
+public:
+  BlockNestedLoopJoin(vector<simplificationLayer::Table> const& input,
+                      vector<std::pair<size_t, size_t>> const& joinAttributeIndices,
+                      vector<vector<simplificationLayer::CyclicPredicate>> const& cyclicPredicatesAt)
+      : input(input), joinAttributeIndices(joinAttributeIndices),
+        cyclicPredicatesAt(cyclicPredicatesAt), output(input.size()) {}
+
+  simplificationLayer::RowIds run() && {
+    auto const numRows = simplificationLayer::getNumRows(input[0]);
+    for(size_t begin = 0; begin < numRows; begin += batchRows) {
+      simplificationLayer::RowIds batch(input.size());
+      for(auto row = begin; row < std::min(numRows, begin + batchRows); row++) {
+        batch[0].push_back(row);
+      }
+      matchFrom(1, batch);
+    }
+    return std::move(output);
+  }
+
+private:
+  vector<simplificationLayer::Table> const& input;
+  vector<std::pair<size_t, size_t>> const& joinAttributeIndices;
+  vector<vector<simplificationLayer::CyclicPredicate>> const& cyclicPredicatesAt;
+  simplificationLayer::RowIds output;
+
+  /// extends a batch of partial results (rows of the tables 0 to i - 1) with the rows of table i
+  void matchFrom(size_t i, simplificationLayer::RowIds const& batch) {
+    if(i == input.size()) {
+      for(size_t t = 0; t < input.size(); t++) {
+        output[t].insert(output[t].end(), batch[t].begin(), batch[t].end());
+      }
+      return;
+    }
+    simplificationLayer::RowIds next(input.size());
+    auto const cyclicPredicatesHold = [&](size_t k, size_t row) {
+      return std::all_of(
+          cyclicPredicatesAt[i].begin(), cyclicPredicatesAt[i].end(), [&](auto const& predicate) {
+            auto const& [lhs, rhs] = predicate; // (rhs is in table i)
+            return simplificationLayer::valuesEqual(input[lhs.table][lhs.column],
+                                                    batch[lhs.table][k],
+                                                    input[rhs.table][rhs.column], row);
+          });
+    };
+    simplificationLayer::visitSameTypeColumns(
+        input[i - 1][joinAttributeIndices[i - 1].first],
+        input[i][joinAttributeIndices[i - 1].second],
+        [&](auto const& leftColumn, auto const& rightColumn) {
+          using Key = typename std::decay_t<decltype(leftColumn)>::value_type;
+          vector<Key> keys(batch[i - 1].size());
+          for(size_t k = 0; k < keys.size(); k++) {
+            keys[k] = leftColumn[batch[i - 1][k]];
+          }
+          forEachBlockMatch(keys.data(), keys.size(), rightColumn, [&](size_t k, size_t row) {
+            if(!cyclicPredicatesHold(k, row)) {
+              return;
+            }
+            for(size_t t = 0; t < i; t++) {
+              next[t].push_back(batch[t][k]);
+            }
+            next[i].push_back(row);
+            if(next[i].size() == batchRows) {
+              matchFrom(i + 1, next);
+              next = simplificationLayer::RowIds(input.size());
+            }
+          });
+        });
+    if(!next[i].empty()) {
+      matchFrom(i + 1, next);
+    }
+  }
+};
+
+} // namespace boss::engines::joinonly
@@ -1,17 +1,37 @@
 #include "NestedLoopJoinOnly.hpp"
 #include "Common.hpp"
 
+#include "NestedLoopJoin.hpp"
 #include "SimplificationLayer.hpp"
 #include <Algorithm.hpp>
 #include <Expression.hpp>
 #include <ExpressionUtilities.hpp>
 #include <Utilities.hpp>
+#include <functional>
 #include <mutex>
 
-namespace boss::engines::joinonly {
+using boss::utilities::operator""_;
+
+namespace boss::engines::joinonly::nestedloopjoinonly {
 using std::vector;
 
 class Engine {
+  /// whether to join with the (tiled, vectorized) block nested-loop join
+  bool blockNestedLoop = true;
+
+  /**
+   * @brief Changes the configuration of the engine, e.g., "Set"_("BlockNestedLoop"_, 0).
+   *
+   * @return false if the option is not one of this engine's.
+   */
+  bool setOption(Symbol const& option, int64_t value) {
+    if(option == "BlockNestedLoop"_) {
+      blockNestedLoop = value != 0;
+      return true;
+    }
+    return false;
+  }
+
   simplificationLayer::JoinHelper performMultiwayJoin(simplificationLayer::JoinHelper&& helper) {
 
     ////////////////////////////////////////////////////////////////////////////////
@@ -21,64 +41,62 @@ class Engine {
     auto const& input = helper.getInputs();
     auto const& joinAttributeIndices = helper.getJoinAttributeIndices();
     // Set the number of cursors to the number of input tables
-    auto cursors = vector<int>(input.size(), 0);
-
-    // Suppose we had cursors [0, 0] and table sizes [2, 2]. Then we would want to increment as
-    // follows:
-    // [0, 0] -> [0, 0]
-    // [0, 1] -> [0, 1]
-    // [0, 2] -> [1, 0]
-    // [1, 0] -> [1, 0]
-    // [1, 2] -> [2, 0]
-    // The idea is we maintain the invaruant that all cursors will point to a table value except
-    // possibly the first one.
-    auto const makeCursorsOverflow = [&]() {
-      for(auto i = cursors.size() - 1; i > 0; i--) {
-        if(cursors[i] >= input[i][0].size()) {
-          cursors[i] = 0;
-          cursors[i - 1]++;
+    auto cursors = vector<size_t>(input.size(), 0);
+    // The result rows, as one vector of row indices (cursors) per input table
+    simplificationLayer::RowIds output(input.size());
+    // The predicates closing cycles, checked as soon as the later of their two tables is matched
+    vector<vector<simplificationLayer::CyclicPredicate>> cyclicPredicatesAt(input.size());
+    for(auto const& predicate : helper.getCyclicPredicates()) {
+      cyclicPredicatesAt[predicate.second.table].push_back(predicate);
+    }
+    if(blockNestedLoop) {
+      helper.appendOutputRowIds(
+          BlockNestedLoopJoin(input, joinAttributeIndices, cyclicPredicatesAt).run());
+      return std::move(helper);
+    }
+    auto cyclicPredicatesHold = [&](size_t i) {
+      for(auto const& [lhs, rhs] : cyclicPredicatesAt[i]) {
+        if(!simplificationLayer::valuesEqual(input[lhs.table][lhs.column], cursors[lhs.table],
+                                             input[rhs.table][rhs.column], cursors[rhs.table])) {
+          return false;
         }
       }
+      return true;
     };
-//    For each row in the first table
-    for(; cursors[0] < input[0][0].size();) {
-      auto isAMatchSoFar = true;
-//      Check each table to see if the join attribute matches
-//      `i`  corresponds to the table index. We start at 1 because we are comparing the second
-//      against the first table
-//      We alwayse check adjacent tables
-//      We check using our current value of `cursors` to see if the join attribute matches
-//      If it does not match, we increment the cursor of the table that is not matching and
-//      reset all the cursors of the tables that are to the right of the table that is not matching
-//      to 0 - as we comparing them against a new value.
-      for(auto i = 1U; isAMatchSoFar && i < input.size(); i++) {
-        if(input[i - 1][joinAttributeIndices[i - 1].first][cursors[i - 1]] !=
-           input[i][joinAttributeIndices[i - 1].second][cursors[i]]) {
-          isAMatchSoFar = false;
-          cursors[i]++;
-          for(auto j = i + 1; j < input.size(); j++) {
-            cursors[j] = 0;
-          }
-        }
-      }
-//      When looking at the rows from indexed from each cursor we found a match
-      if(isAMatchSoFar) {
-        vector<simplificationLayer::Value> resultTuple;
-//        For each table
-        for(auto i = 0u; i < input.size(); i++) {
-//          For each column in the table
-          for(auto& column : input[i]) {
-//            Add a
-            resultTuple.push_back(column[cursors[i]]);
-          }
+
+    // We iterate depth-first over the tables: for the current row (cursor) of table `i - 1`, we scan
+    // table `i` for the rows whose join attribute matches and, for each of them, recurse into table
+    // `i + 1`. This enumerates the same combinations of cursors, in the same order, as advancing
+    // all the cursors at once (like an odometer), but each scan runs as a tight loop over the typed
+    // join attribute columns: the column types are dispatched once per scan, not once per value.
+    std::function<void(size_t)> matchFrom = [&](size_t i) {
+      if(i == input.size()) {
+        // When looking at the rows indexed from each cursor we found a match:
+        // record the cursor of each table (the values are gathered in bulk by the helper)
+        for(auto t = 0U; t < input.size(); t++) {
+          output[t].push_back(cursors[t]);
         }
-//        Increment the cursor of the last table
-        cursors.back()++;
-//        Output the result we found
-        helper.appendOutput(resultTuple);
+        return;
       }
-      makeCursorsOverflow();
+      // We always check adjacent tables
+      simplificationLayer::visitSameTypeColumns(
+          input[i - 1][joinAttributeIndices[i - 1].first],
+          input[i][joinAttributeIndices[i - 1].second],
+          [&](auto const& leftColumn, auto const& rightColumn) {
+            auto const& value = leftColumn[cursors[i - 1]];
+            for(cursors[i] = 0; cursors[i] < rightColumn.size(); cursors[i]++) {
+              if(rightColumn[cursors[i]] == value && cyclicPredicatesHold(i)) {
+                matchFrom(i + 1);
+              }
+            }
+          });
+    };
+    // For each row in the first table
+    for(cursors[0] = 0; cursors[0] < simplificationLayer::getNumRows(input[0]); cursors[0]++) {
+      matchFrom(1);
     }
+    // Output the results we found
+    helper.appendOutputRowIds(std::move(output));
 
     ////////////////////////////////////////////////////////////////////////////////
     /////////////////// end of code that is relevant to students ///////////////////
@@ -91,7 +109,14 @@ public:
     try {
       return visit(boss::utilities::overload(
                        [this](ComplexExpression&& e) -> Expression {
-                         if(e.getHead().getName() == "Join") {
+                         auto const& args = e.getDynamicArguments();
+                         if(e.getHead() == "Set"_ && args.size() == 2 &&
+                            std::holds_alternative<Symbol>(args[0]) &&
+                            std::holds_alternative<int64_t>(args[1]) &&
+                            setOption(get<Symbol>(args[0]), get<int64_t>(args[1]))) {
+                           return true;
+                         }
+                         if(simplificationLayer::JoinHelper::isJoinPlan(e)) {
                            return performMultiwayJoin(simplificationLayer::JoinHelper(std::move(e)))
                                .getResult();
                          } else {
@@ -117,12 +142,14 @@ public:
   }
 };
 
-} // namespace boss::engines::joinonly
+} // namespace boss::engines::joinonly::nestedloopjoinonly
+
+using boss::engines::joinonly::nestedloopjoinonly::Engine;
 
 static auto& enginePtr(bool initialise = true) {
-  static auto engine = std::unique_ptr<boss::engines::joinonly::Engine>();
+  static auto engine = std::unique_ptr<Engine>();
   if(!engine && initialise) {
-    engine.reset(new boss::engines::joinonly::Engine());
+    engine.reset(new Engine());
   }
   return engine;
 }
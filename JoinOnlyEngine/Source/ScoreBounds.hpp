@@ -0,0 +1,166 @@
+#pragma once
+
+#include "JoinOrder.hpp"
+#include "SimplificationLayer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace simplificationLayer {
+
+/**
+ * Branch-and-bound on the scores of the result rows (the selections on scores and the Top above
+ * the join), while the partial results are extended one step of a join order at a time.
+ *
+ * A partial result keeps, for each score, the sum of the terms of the tables joined so far. The
+ * tables joined at the next steps can add at most the maxima of their columns: if even that cannot
+ * pass a selection, or enter the current top rows, the partial result is pruned.
+ *
+ * The scores are summed in a different order than by the operators applied on the result, so they
+ * are compared with a small tolerance: the join keeps (at least) all the rows that these operators
+ * keep, which still select the exact result.
+ */
+class ScoreBounds {
+public:
+  ScoreBounds(std::vector<Table> const& input, JoinOrder const& order,
+              std::vector<ScoreThreshold> const& thresholds, std::optional<TopScores> const& top)
+      : input(input), thresholds(thresholds), topN(top ? top->n : 0) {
+    std::vector<Score const*> scoresToBound;
+    for(auto const& threshold : thresholds) {
+      scoresToBound.push_back(&threshold.score);
+    }
+    if(top) {
+      scoresToBound.push_back(&top->score);
+    }
+    // the position of each table in the join order (the probe table first)
+    std::vector<size_t> position(input.size(), 0);
+    for(size_t k = 0; k < order.steps.size(); k++) {
+      position[order.steps[k].table] = k + 1;
+    }
+    termsOf.assign(scoresToBound.size(), std::vector<std::vector<size_t>>(input.size()));
+    maxRemaining.assign(scoresToBound.size(), std::vector<double>(order.steps.size() + 2, 0));
+    tolerances.assign(scoresToBound.size(), 1);
+    for(size_t s = 0; s < scoresToBound.size(); s++) {
+      for(auto const& term : scoresToBound[s]->terms) {
+        termsOf[s][term.table].push_back(term.column);
+        auto const [min, max] = rangeOf(input[term.table][term.column]);
+        maxRemaining[s][position[term.table]] += max;
+        tolerances[s] += std::max(std::abs(min), std::abs(max));
+      }
+      tolerances[s] *= relativeTolerance;
+      // from the contribution of each position to the maximum of all the positions after it
+      for(size_t k = order.steps.size() + 1; k-- > 0;) {
+        maxRemaining[s][k] += maxRemaining[s][k + 1];
+      }
+    }
+  }
+
+  /// whether there is anything to prune with (and whether the bounds are valid: no NaN or infinity)
+  bool enabled() const { return !termsOf.empty() && allFinite; }
+
+  size_t numScores() const { return termsOf.size(); }
+
+  /// adds the terms of a row of a table to the sums of the scores of a partial result
+  void addTerms(size_t table, size_t row, double const* sums, double* newSums) const {
+    for(size_t s = 0; s < termsOf.size(); s++) {
+      newSums[s] = sums[s];
+      for(auto column : termsOf[s][table]) {
+        newSums[s] += std::visit(
+            [row](auto const& values) { return static_cast<double>(values[row]); },
+            input[table][column]);
+      }
+    }
+  }
+
+  /**
+   * @brief Checks if a partial result may still be part of a result row that is kept.
+   *
+   * @param joined The number of tables joined so far (the probe table included).
+   */
+  bool mayQualify(size_t joined, double const* sums) const {
+    for(size_t s = 0; s < thresholds.size(); s++) {
+      if(sums[s] + maxRemaining[s][joined] <= thresholds[s].threshold - tolerances[s]) {
+        return false;
+      }
+    }
+    if(topN > 0 && topScores.size() == topN) {
+      auto const s = thresholds.size();
+      return sums[s] + maxRemaining[s][joined] >= topScores.top() - tolerances[s];
+    }
+    return true;
+  }
+
+  /**
+   * @brief Checks a result row (with all its tables joined) and, if it is kept, records its score
+   * in the current top rows.
+   */
+  bool keep(double const* sums) {
+    for(size_t s = 0; s < thresholds.size(); s++) {
+      if(sums[s] <= thresholds[s].threshold - tolerances[s]) {
+        return false;
+      }
+    }
+    if(topN == 0) {
+      return true;
+    }
+    auto const score = sums[thresholds.size()];
+    if(topScores.size() < topN) {
+      topScores.push(score);
+      return true;
+    }
+    if(score < topScores.top() - tolerances.back()) {
+      return false;
+    }
+    if(score > topScores.top()) {
+      topScores.pop();
+      topScores.push(score);
+    }
+    return true;
+  }
+
+  /// the top score of a result row (to drop the kept rows that fell out of the top rows later on)
+  double topScoreOf(double const* sums) const { return sums[thresholds.size()]; }
+
+  /// whether a kept result row, with that top score, is still among the final top rows
+  bool inFinalTop(double score) const {
+    return topN == 0 || topScores.size() < topN || score >= topScores.top() - tolerances.back();
+  }
+
+private:
+  std::vector<Table> const& input;
+  std::vector<ScoreThreshold> const& thresholds;
+  size_t topN;
+  /// for each score (the thresholds, then the top score), the columns of its terms in each table
+  std::vector<std::vector<std::vector<size_t>>> termsOf;
+  /// for each score, the maximum that the tables at positions k and after can add
+  std::vector<std::vector<double>> maxRemaining;
+  /// for each score, the largest rounding error of its sums (from the magnitude of its terms)
+  std::vector<double> tolerances;
+  /// the n highest scores of the result rows kept so far (the lowest at the top)
+  std::priority_queue<double, std::vector<double>, std::greater<>> topScores;
+  bool allFinite = true;
+
+  static constexpr double relativeTolerance = 1e-9;
+
+  /// the smallest (or zero) and the largest values of a column (-infinity if it is empty)
+  std::pair<double, double> rangeOf(Column const& column) {
+    return std::visit(
+        [this](auto const& values) {
+          auto min = 0.0;
+          auto max = -std::numeric_limits<double>::infinity();
+          for(auto value : values) {
+            allFinite = allFinite && std::isfinite(static_cast<double>(value));
+            min = std::min(min, static_cast<double>(value));
+            max = std::max(max, static_cast<double>(value));
+          }
+          return std::make_pair(min, max);
+        },
+        column);
+  }
+};
+
+} // namespace simplificationLayer
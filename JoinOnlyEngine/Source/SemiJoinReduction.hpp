@@ -0,0 +1,85 @@
+#pragma once
+
+#include "HashJoin.hpp"
+#include "SimplificationLayer.hpp"
+#include <vector>
+
+namespace simplificationLayer {
+
+/**
+ * @brief Marks the rows of a table that have no match in another table as dead (a semi-join).
+ *
+ * @param targetKeys The join attribute of the table to reduce.
+ * @param targetAlive The live rows of the table to reduce (updated in-place).
+ * @param sourceKeys The join attribute of the table to semi-join with.
+ * @param sourceAlive The live rows of the table to semi-join with.
+ */
+inline void semiJoin(Column const& targetKeys, std::vector<bool>& targetAlive,
+                     Column const& sourceKeys, std::vector<bool> const& sourceAlive) {
+  bool const sameType =
+      visitSameTypeColumns(targetKeys, sourceKeys, [&](auto const& target, auto const& source) {
+        using Key = typename std::decay_t<decltype(target)>::value_type;
+        // the keys of the live rows, hashed as for the join (only their presence is looked up)
+        std::vector<Key> liveKeys;
+        liveKeys.reserve(source.size());
+        for(size_t row = 0; row < source.size(); row++) {
+          if(sourceAlive[row]) {
+            liveKeys.push_back(source[row]);
+          }
+        }
+        boss::engines::joinonly::HashTable<Key> const keys(liveKeys.data(), liveKeys.size());
+        for(size_t row = 0; row < target.size(); row++) {
+          if(targetAlive[row] && keys.lookup(target[row]).empty()) {
+            targetAlive[row] = false;
+          }
+        }
+      });
+  if(!sameType) {
+    // values of different types never match
+    std::fill(targetAlive.begin(), targetAlive.end(), false);
+  }
+}
+
+/**
+ * @brief Drops the dangling rows of the inputs of a join chain before joining them (Yannakakis'
+ * full reducer).
+ *
+ * A forward sweep semi-joins each table with the one before it, then a backward sweep semi-joins
+ * each table with the one after it. For an acyclic chain, every row left is then part of at least
+ * one result, so the join itself does not materialize any intermediate result that is dropped
+ * later. The predicates closing cycles are not used: the rows left are still a superset of the
+ * ones in the result, so the join stays correct.
+ *
+ * The inputs of the helper are replaced with the reduced ones (this must be called before any
+ * output is appended).
+ */
+inline void semiJoinReduce(JoinHelper& helper) {
+  auto const& inputs = helper.getInputs();
+  auto const& joinAttributeIndices = helper.getJoinAttributeIndices();
+  std::vector<std::vector<bool>> alive;
+  alive.reserve(inputs.size());
+  for(auto const& table : inputs) {
+    alive.emplace_back(getNumRows(table), true);
+  }
+  // forward sweep: table j + 1 semi-joined with table j
+  for(size_t j = 0; j < joinAttributeIndices.size(); j++) {
+    semiJoin(inputs[j + 1][joinAttributeIndices[j].second], alive[j + 1],
+             inputs[j][joinAttributeIndices[j].first], alive[j]);
+  }
+  // backward sweep: table j semi-joined with table j + 1
+  for(size_t j = joinAttributeIndices.size(); j-- > 0;) {
+    semiJoin(inputs[j][joinAttributeIndices[j].first], alive[j],
+             inputs[j + 1][joinAttributeIndices[j].second], alive[j + 1]);
+  }
+  std::vector<std::vector<size_t>> rowsToKeep(inputs.size());
+  for(size_t t = 0; t < inputs.size(); t++) {
+    for(size_t row = 0; row < alive[t].size(); row++) {
+      if(alive[t][row]) {
+        rowsToKeep[t].push_back(row);
+      }
+    }
+  }
+  helper.filterInputs(rowsToKeep);
+}
+
+} // namespace simplificationLayer
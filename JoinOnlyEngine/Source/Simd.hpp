@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// SSE2 is part of x86-64: it is used whenever the target is x86-64 (wider instruction sets, such
+// as AVX2, would need a build flag that targets specific CPUs)
+#if defined(__SSE2__) || defined(_M_X64)
+#define JOINONLY_SSE2 1
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace boss::engines::joinonly {
+
+/// the index of the lowest bit set (mask must not be zero)
+inline unsigned countTrailingZeros(uint32_t mask) {
+#ifdef _MSC_VER
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+inline unsigned countTrailingZeros(uint64_t mask) {
+#ifdef _MSC_VER
+  unsigned long index = 0;
+  _BitScanForward64(&index, mask);
+  return index;
+#else
+  return __builtin_ctzll(mask);
+#endif
+}
+
+/**
+ * @brief Compares a block of (at most 64) keys with a value.
+ *
+ * @return A mask with bit j set if keys[j] == value.
+ */
+inline uint64_t equalMask(int64_t const* keys, size_t size, int64_t value) {
+  uint64_t mask = 0;
+  size_t j = 0;
+#if defined(JOINONLY_SSE2)
+  // (SSE2 has no 64-bit comparison: both 32-bit halves must be equal)
+  auto const values = _mm_set1_epi64x(value);
+  for(; j + 2 <= size; j += 2) {
+    auto const block = _mm_loadu_si128(reinterpret_cast<__m128i const*>(keys + j));
+    auto const halves = _mm_cmpeq_epi32(block, values);
+    auto const equal = _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+    mask |= static_cast<uint64_t>(_mm_movemask_pd(_mm_castsi128_pd(equal))) << j;
+  }
+#endif
+  for(; j < size; j++) {
+    mask |= static_cast<uint64_t>(keys[j] == value) << j;
+  }
+  return mask;
+}
+inline uint64_t equalMask(double_t const* keys, size_t size, double_t value) {
+  uint64_t mask = 0;
+  size_t j = 0;
+#if defined(JOINONLY_SSE2)
+  auto const values = _mm_set1_pd(value);
+  for(; j + 2 <= size; j += 2) {
+    auto const equal = _mm_cmpeq_pd(_mm_loadu_pd(keys + j), values);
+    mask |= static_cast<uint64_t>(_mm_movemask_pd(equal)) << j;
+  }
+#endif
+  for(; j < size; j++) {
+    mask |= static_cast<uint64_t>(keys[j] == value) << j;
+  }
+  return mask;
+}
+
+} // namespace boss::engines::joinonly
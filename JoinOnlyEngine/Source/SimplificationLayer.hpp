@@ -4,24 +4,316 @@
 #include <Expression.hpp>
 #include <ExpressionUtilities.hpp>
 #include <Utilities.hpp>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <variant>
 namespace simplificationLayer {
 using namespace boss;
 using namespace utilities;
 using Value = std::variant<int64_t, double>;
-using Column = std::vector<Value>;
-using Table = std::vector<Column>;
+/// one vector of row indices per input table (in the same order as the inputs)
+using RowIds = std::vector<std::vector<size_t>>;
 using Schema = std::vector<std::string>;
 
+/**
+ * A read-only, contiguous column of values of a single type (known when the plan is parsed).
+ * The underlying storage (an owned vector or a borrowed span) is shared: copying a column does
+ * not copy its values.
+ */
+template <typename T> class TypedColumn {
+public:
+  using value_type = T;
+
+  TypedColumn() = default;
+  explicit TypedColumn(std::vector<T>&& data) {
+    auto owned = std::make_shared<std::vector<T> const>(std::move(data));
+    values = owned->data();
+    length = owned->size();
+    storage = std::move(owned);
+  }
+
+  /// borrows the buffer of a span, which is kept alive (but not copied) as long as the column
+  template <typename U, typename = std::enable_if_t<std::is_same_v<std::remove_const_t<U>, T>>>
+  explicit TypedColumn(boss::Span<U>&& span) {
+    auto borrowed = std::make_shared<boss::Span<U> const>(std::move(span));
+    values = borrowed->begin();
+    length = borrowed->size();
+    storage = std::move(borrowed);
+  }
+
+  size_t size() const { return length; }
+  T const& operator[](size_t i) const { return values[i]; }
+  T const* data() const { return values; }
+  T const* begin() const { return values; }
+  T const* end() const { return values + length; }
+
+private:
+  std::shared_ptr<void const> storage;
+  T const* values = nullptr;
+  size_t length = 0;
+};
+
+using Column = std::variant<TypedColumn<int64_t>, TypedColumn<double_t>>;
+using Table = std::vector<Column>;
+
+inline size_t getSize(Column const& column) {
+  return std::visit([](auto const& typedColumn) { return typedColumn.size(); }, column);
+}
+
+/// the number of rows of a table (zero if it does not have any column)
+inline size_t getNumRows(Table const& table) { return table.empty() ? 0 : getSize(table[0]); }
+
+/// type-erased access to a single value (avoid in hot loops: visit the column once instead)
+inline Value getValue(Column const& column, size_t row) {
+  return std::visit([row](auto const& typedColumn) -> Value { return typedColumn[row]; }, column);
+}
+
+/**
+ * @brief Calls f with both columns as typed columns if they hold the same value type.
+ *
+ * The joins of an int64_t column with a double column are left to the next engine (see
+ * JoinHelper::isJoinPlan), which compares the values numerically. Columns of different types are
+ * only left when one of them is empty: nothing matches, and f is not called.
+ *
+ * @return true if f has been called.
+ */
+template <typename F> bool visitSameTypeColumns(Column const& lhs, Column const& rhs, F&& f) {
+  return std::visit(
+      [&f](auto const& typedLhs, auto const& typedRhs) {
+        if constexpr(std::is_same_v<std::decay_t<decltype(typedLhs)>,
+                                    std::decay_t<decltype(typedRhs)>>) {
+          f(typedLhs, typedRhs);
+          return true;
+        } else {
+          return false;
+        }
+      },
+      lhs, rhs);
+}
+
+/// a column of one of the input tables
+struct Attribute {
+  size_t table;
+  size_t column;
+};
+
+/**
+ * An equality between columns of two different inputs that comes from a selection above the join
+ * (e.g., the predicate closing a cycle of joins). first.table < second.table.
+ */
+using CyclicPredicate = std::pair<Attribute, Attribute>;
+
+/**
+ * @brief Checks an equality between values of two columns (with the same type).
+ */
+inline bool valuesEqual(Column const& lhs, size_t lhsRow, Column const& rhs, size_t rhsRow) {
+  bool equal = false;
+  visitSameTypeColumns(lhs, rhs, [&](auto const& typedLhs, auto const& typedRhs) {
+    equal = typedLhs[lhsRow] == typedRhs[rhsRow];
+  });
+  return equal;
+}
+
+/**
+ * Result rows of a join in factorized form: rather than one row id per table for every result
+ * row, the matches of each table are stored once per row of the table it is joined to.
+ *
+ * Level 0 holds the rows of the first table joined (the roots). Each following level holds the
+ * rows of one more table, joined to the rows of an earlier (parent) level: the children of the
+ * node i of the parent level are the nodes children[offsets[i]] to children[offsets[i + 1] - 1]
+ * of the level. A result row picks a root and, for each following level, a child of the node
+ * picked at its parent level.
+ *
+ * Its size grows with the sum of the matches of each join step, where the flat result grows with
+ * their product (e.g., with duplicate keys on every hop of a chain).
+ */
+struct FactorizedRowIds {
+  struct Level {
+    /// the input table of the rows of this level
+    size_t table;
+    /// the level that this one is joined to (unused for the roots)
+    size_t parent;
+    /// the row of each node
+    std::vector<size_t> rows;
+    /// for each node of the parent level, where its children start (and end) in `children`
+    std::vector<size_t> offsets;
+    std::vector<size_t> children;
+  };
+  std::vector<Level> levels;
+
+  /// for each level, the number of result rows below each of its nodes
+  std::vector<std::vector<size_t>> countRowsBelow() const {
+    std::vector<std::vector<size_t>> rowsBelow(levels.size());
+    for(size_t l = 0; l < levels.size(); l++) {
+      rowsBelow[l].assign(levels[l].rows.size(), 1);
+    }
+    // (a level only has children levels after it)
+    for(size_t l = levels.size(); l-- > 1;) {
+      auto const& level = levels[l];
+      auto& parentRowsBelow = rowsBelow[level.parent];
+      for(size_t node = 0; node < parentRowsBelow.size(); node++) {
+        size_t sum = 0;
+        for(auto c = level.offsets[node]; c < level.offsets[node + 1]; c++) {
+          sum += rowsBelow[l][level.children[c]];
+        }
+        parentRowsBelow[node] *= sum;
+      }
+    }
+    return rowsBelow;
+  }
+
+  /// the number of result rows (without flattening them)
+  size_t getNumRows() const {
+    if(levels.empty()) {
+      return 0;
+    }
+    auto const rowsBelow = countRowsBelow();
+    return std::accumulate(rowsBelow[0].begin(), rowsBelow[0].end(), size_t(0));
+  }
+
+  /**
+   * @brief Enumerates the result rows, as one vector of row indices per input table.
+   *
+   * The nodes without any result row below them are skipped, so the enumeration never reaches a
+   * dead end.
+   */
+  RowIds flatten(size_t numTables) const {
+    RowIds flat(numTables);
+    if(levels.empty()) {
+      return flat;
+    }
+    auto const rowsBelow = countRowsBelow();
+    auto const numRows = std::accumulate(rowsBelow[0].begin(), rowsBelow[0].end(), size_t(0));
+    for(auto const& level : levels) {
+      flat[level.table].reserve(numRows);
+    }
+    std::vector<size_t> picked(levels.size());
+    std::function<void(size_t)> pickFrom = [&](size_t l) {
+      if(l == levels.size()) {
+        for(size_t m = 0; m < levels.size(); m++) {
+          flat[levels[m].table].push_back(levels[m].rows[picked[m]]);
+        }
+        return;
+      }
+      auto const& level = levels[l];
+      auto const parentNode = picked[level.parent];
+      for(auto c = level.offsets[parentNode]; c < level.offsets[parentNode + 1]; c++) {
+        if(rowsBelow[l][level.children[c]] > 0) {
+          picked[l] = level.children[c];
+          pickFrom(l + 1);
+        }
+      }
+    };
+    for(size_t root = 0; root < levels[0].rows.size(); root++) {
+      if(rowsBelow[0][root] > 0) {
+        picked[0] = root;
+        pickFrom(1);
+      }
+    }
+    return flat;
+  }
+};
+
+/**
+ * A score of the result rows: the sum of columns of the inputs, e.g., Plus(Length0, Length1) for
+ * the length of a path.
+ */
+struct Score {
+  std::vector<Attribute> terms;
+};
+
+/// a selection on a score, e.g., Select(..., Where(Greater(Plus(Length0, Length1), 17)))
+struct ScoreThreshold {
+  Score score;
+  /// only the rows scoring more than this are kept
+  double threshold;
+};
+
+/// a Top(..., n, score) above the join: only the n rows with the highest scores are kept
+struct TopScores {
+  Score score;
+  size_t n;
+};
+
 class JoinHelper {
 private: // state
   std::vector<Table> inputs;
   std::vector<std::pair<size_t, size_t>> joinAttributeIndices;
+  std::vector<CyclicPredicate> cyclicPredicates;
+  // the selections above the join that are not evaluated by the join (applied on its result)
+  std::vector<Expression> residualSelections;
+  // the selections on scores (also kept in residualSelections), that the join can evaluate early
+  std::vector<ScoreThreshold> scoreThresholds;
+  // the Top above the join (and its selections), applied on its result
+  std::optional<std::pair<int64_t, Expression>> top;
+  std::optional<TopScores> topScores;
+  std::vector<Schema> inputSchemas;
   Schema mergedSchema;
 
   std::vector<std::variant<std::vector<int64_t>, std::vector<double_t>>> result;
+  // batches of result rows, not materialized until getResult() is called
+  std::vector<RowIds> outputRowIds;
+  // batches of result rows in factorized form, only flattened when getResult() is called
+  std::vector<FactorizedRowIds> factorizedOutputRowIds;
 
 private: // utility functions
+  /**
+   * Gathers the values of the pending row id batches into the result columns:
+   * column by column, with typed loops, into vectors that are sized once.
+   */
+  void materializeOutputRowIds() {
+    for(auto const& factorized : factorizedOutputRowIds) {
+      outputRowIds.emplace_back(factorized.flatten(inputs.size()));
+    }
+    factorizedOutputRowIds.clear();
+    size_t numNewRows = 0;
+    for(auto const& rowIds : outputRowIds) {
+      numNewRows += rowIds.empty() ? 0 : rowIds[0].size();
+    }
+    if(numNewRows == 0) {
+      outputRowIds.clear();
+      return;
+    }
+    if(result.empty()) {
+      for(auto const& table : inputs) {
+        for(auto const& column : table) {
+          std::visit(
+              [this](auto const& typedColumn) {
+                using T = typename std::decay_t<decltype(typedColumn)>::value_type;
+                result.emplace_back(std::vector<T>());
+              },
+              column);
+        }
+      }
+    }
+    auto resultIt = result.begin();
+    for(size_t t = 0; t < inputs.size(); t++) {
+      for(auto const& column : inputs[t]) {
+        std::visit(
+            [this, t, numNewRows](auto& resultColumn, auto const& inputColumn) {
+              using T = typename std::decay_t<decltype(inputColumn)>::value_type;
+              if constexpr(std::is_same_v<std::decay_t<decltype(resultColumn)>, std::vector<T>>) {
+                auto offset = resultColumn.size();
+                resultColumn.resize(offset + numNewRows);
+                auto* out = resultColumn.data() + offset;
+                for(auto const& rowIds : outputRowIds) {
+                  for(auto row : rowIds[t]) {
+                    *out++ = inputColumn[row];
+                  }
+                }
+              } else {
+                throw std::runtime_error("result column type does not match the input column");
+              }
+            },
+            *resultIt++, column);
+      }
+    }
+    outputRowIds.clear();
+  }
+
   std::tuple<Schema, Table> toSchemaAndData(ComplexExpression&& e) {
     Schema schema;
     Table table;
@@ -30,35 +322,382 @@ private: // utility functions
           boss::get<ComplexExpression>(std::move(columnExpr)).decompose();
       schema.emplace_back(std::move(head).getName());
       auto list = *std::make_move_iterator(dynamics.begin());
-      auto& column = table.emplace_back();
-      for(auto&& valExpr : boss::get<ComplexExpression>(list).getArguments()) {
-        boss::expressions::generic::visit(
-            overload([&column](int64_t v) { column.emplace_back(v); },
-                     [&column](double_t v) { column.emplace_back(v); },
-                     [](auto&&) { throw std::runtime_error("unsupported type"); }),
-            std::move(valExpr));
-      }
+      table.emplace_back(toColumn(boss::get<ComplexExpression>(std::move(list))));
     }
     return {std::move(schema), std::move(table)};
   }
 
+  /**
+   * @brief The symbols of a Where(Equal(symbol, symbol)) predicate, if it is one.
+   */
+  static std::optional<std::pair<Symbol, Symbol>> getEqualitySymbols(Expression const& where) {
+    if(!std::holds_alternative<ComplexExpression>(where)) {
+      return {};
+    }
+    auto const& whereExpr = get<ComplexExpression>(where);
+    if(whereExpr.getHead() != "Where"_ || whereExpr.getDynamicArguments().size() != 1 ||
+       !std::holds_alternative<ComplexExpression>(whereExpr.getDynamicArguments()[0])) {
+      return {};
+    }
+    auto const& equal = get<ComplexExpression>(whereExpr.getDynamicArguments()[0]);
+    if(equal.getHead() != "Equal"_ || equal.getDynamicArguments().size() != 2 ||
+       !std::holds_alternative<Symbol>(equal.getDynamicArguments()[0]) ||
+       !std::holds_alternative<Symbol>(equal.getDynamicArguments()[1])) {
+      return {};
+    }
+    return std::make_pair(get<Symbol>(equal.getDynamicArguments()[0]),
+                          get<Symbol>(equal.getDynamicArguments()[1]));
+  }
+
+  /**
+   * @brief The arguments of a Greater(score, number) predicate (in a Where or not), if it is one.
+   */
+  static std::optional<std::pair<Expression const*, double>>
+  getGreaterThanNumber(Expression const& where) {
+    if(!std::holds_alternative<ComplexExpression>(where)) {
+      return {};
+    }
+    auto const* greater = &get<ComplexExpression>(where);
+    if(greater->getHead() == "Where"_ && greater->getDynamicArguments().size() == 1 &&
+       std::holds_alternative<ComplexExpression>(greater->getDynamicArguments()[0])) {
+      greater = &get<ComplexExpression>(greater->getDynamicArguments()[0]);
+    }
+    if(greater->getHead() != "Greater"_ || greater->getDynamicArguments().size() != 2) {
+      return {};
+    }
+    auto const& bound = greater->getDynamicArguments()[1];
+    if(std::holds_alternative<int64_t>(bound)) {
+      return std::make_pair(&greater->getDynamicArguments()[0],
+                            static_cast<double>(get<int64_t>(bound)));
+    }
+    if(std::holds_alternative<double_t>(bound)) {
+      return std::make_pair(&greater->getDynamicArguments()[0], get<double_t>(bound));
+    }
+    return {};
+  }
+
+  /// converts a column symbol or a Plus of them (possibly nested) into a score
+  std::optional<Score> toScore(Expression const& expr) const {
+    if(std::holds_alternative<Symbol>(expr)) {
+      auto attribute = findAttribute(get<Symbol>(expr));
+      if(!attribute) {
+        return {};
+      }
+      return Score{{*attribute}};
+    }
+    if(!std::holds_alternative<ComplexExpression>(expr) ||
+       get<ComplexExpression>(expr).getHead() != "Plus"_) {
+      return {};
+    }
+    Score score;
+    for(auto const& arg : get<ComplexExpression>(expr).getDynamicArguments()) {
+      auto term = toScore(arg);
+      if(!term) {
+        return {};
+      }
+      score.terms.insert(score.terms.end(), term->terms.begin(), term->terms.end());
+    }
+    return score;
+  }
+
+  /// finds the table and column of a column symbol (the first table that has it)
+  std::optional<Attribute> findAttribute(Symbol const& symbol) const {
+    for(size_t t = 0; t < inputSchemas.size(); t++) {
+      auto it = std::find(inputSchemas[t].begin(), inputSchemas[t].end(), symbol.getName());
+      if(it != inputSchemas[t].end()) {
+        return Attribute{t, (size_t)std::distance(inputSchemas[t].begin(), it)};
+      }
+    }
+    return {};
+  }
+
+  /**
+   * Converts a selection into a cyclic predicate, if it is an equality between columns of two
+   * different inputs with the same type (the selection compares an int64_t and a double
+   * numerically, unlike the join: such a predicate is left to the selection).
+   */
+  std::optional<CyclicPredicate> toCyclicPredicate(Expression const& where) const {
+    auto symbols = getEqualitySymbols(where);
+    if(!symbols) {
+      return {};
+    }
+    auto lhs = findAttribute(symbols->first);
+    auto rhs = findAttribute(symbols->second);
+    if(!lhs || !rhs || lhs->table == rhs->table ||
+       inputs[lhs->table][lhs->column].index() != inputs[rhs->table][rhs->column].index()) {
+      return {};
+    }
+    if(lhs->table > rhs->table) {
+      std::swap(lhs, rhs);
+    }
+    return CyclicPredicate{*lhs, *rhs};
+  }
+
+  /**
+   * Converts a list expression into a typed column.
+   * A list backed by a single span (as produced by the storage engines) is borrowed without
+   * copying any value. Only lists of dynamic arguments (or of several spans) are copied.
+   */
+  static Column toColumn(ComplexExpression&& list) {
+    if(list.getDynamicArguments().empty() && list.getSpanArguments().size() == 1) {
+      auto [head, unused_, unused2_, spans] = std::move(list).decompose();
+      return std::visit(
+          [](auto&& span) -> Column {
+            using T = std::remove_const_t<typename std::decay_t<decltype(span)>::element_type>;
+            if constexpr(std::is_same_v<T, int64_t> || std::is_same_v<T, double_t>) {
+              return TypedColumn<T>(std::move(span));
+            } else {
+              throw std::runtime_error("unsupported type");
+            }
+          },
+          std::move(spans.front()));
+    }
+    auto values = list.getArguments();
+    // the type of the first value decides the type of the whole column
+    if(!values.empty() && std::holds_alternative<double_t>(values.front())) {
+      return toTypedColumn<double_t>(std::move(values));
+    }
+    return toTypedColumn<int64_t>(std::move(values));
+  }
+
+  template <typename T, typename Arguments>
+  static TypedColumn<T> toTypedColumn(Arguments&& values) {
+    std::vector<T> column;
+    column.reserve(values.size());
+    for(auto&& valExpr : values) {
+      boss::expressions::generic::visit(
+          [&column](auto&& v) {
+            using V = std::decay_t<decltype(v)>;
+            if constexpr(std::is_same_v<V, T>) {
+              column.push_back(v);
+            } else if constexpr(std::is_same_v<V, int64_t> || std::is_same_v<V, double_t>) {
+              // (the plans with such columns are left to the next engine: see hasTypedColumns)
+              throw std::runtime_error("mixed value types in a column");
+            } else {
+              throw std::runtime_error("unsupported type");
+            }
+          },
+          std::move(valExpr));
+    }
+    return TypedColumn<T>(std::move(column));
+  }
+
 public:
   JoinHelper(const JoinHelper&) = default;
   JoinHelper(JoinHelper&&) = default;
   JoinHelper& operator=(const JoinHelper&) = default;
   JoinHelper& operator=(JoinHelper&&) = default;
   JoinHelper(Expression&& expr) {
+    // peel off a Top above the join (and its selections): it is applied on the result
+    if(std::holds_alternative<ComplexExpression>(expr) &&
+       get<ComplexExpression>(expr).getHead() == "Top"_) {
+      auto [head, unused_, dynamics, unused2_] =
+          std::move(boss::get<ComplexExpression>(expr)).decompose();
+      top.emplace(get<int64_t>(dynamics.at(1)), std::move(dynamics.at(2)));
+      expr = std::move(dynamics.at(0));
+    }
+    // peel off the equality selections directly above the join: they become cyclic predicates
+    std::vector<Expression> selections;
+    while(std::holds_alternative<ComplexExpression>(expr) &&
+          get<ComplexExpression>(expr).getHead() == "Select"_) {
+      auto [head, unused_, dynamics, unused2_] =
+          std::move(boss::get<ComplexExpression>(expr)).decompose();
+      selections.emplace_back(std::move(dynamics.at(1)));
+      expr = std::move(dynamics.at(0));
+    }
     auto [schemas, tables, indices] = getInputsFromPlan(std::move(expr));
     for(auto indicesIt = indices.begin(); indicesIt != indices.end(); indicesIt += 2) {
       joinAttributeIndices.emplace_back(std::move(*indicesIt), std::move(*(indicesIt + 1)));
     }
     inputs = std::move(tables);
-    for(auto&& schema : schemas) {
-      mergedSchema.insert(mergedSchema.end(), std::make_move_iterator(schema.begin()),
-                          std::make_move_iterator(schema.end()));
+    for(auto const& schema : schemas) {
+      mergedSchema.insert(mergedSchema.end(), schema.begin(), schema.end());
+    }
+    inputSchemas = std::move(schemas);
+    // from the innermost selection to the outermost one
+    for(auto it = selections.rbegin(); it != selections.rend(); ++it) {
+      auto predicate = toCyclicPredicate(*it);
+      if(predicate) {
+        cyclicPredicates.push_back(*predicate);
+        continue;
+      }
+      if(auto greater = getGreaterThanNumber(*it)) {
+        if(auto score = toScore(*greater->first)) {
+          scoreThresholds.push_back({std::move(*score), greater->second});
+        }
+      }
+      residualSelections.emplace_back(std::move(*it));
+    }
+    // the top rows can only be chosen by the join if no other selection is applied after it
+    if(top && top->first > 0 && residualSelections.size() == scoreThresholds.size()) {
+      if(auto score = toScore(top->second)) {
+        topScores = TopScores{std::move(*score), static_cast<size_t>(top->first)};
+      }
+    }
+  }
+
+  /**
+   * @brief Checks if an expression is a plan that the helper handles: a Join, possibly below
+   * selections with a (single) equality between two columns or a comparison of a sum of columns
+   * with a number, and a Top, e.g.,
+   * Top(Select(Join(...), Where(Equal(From0, To3))), 10, Plus(Length0, Length1)).
+   */
+  static bool isJoinPlan(ComplexExpression const& e) {
+    if(e.getHead() == "Join"_) {
+      return hasTypedColumns(e) && joinKeysHaveSameType(e);
+    }
+    auto const& args = e.getDynamicArguments();
+    if(e.getHead() == "Top"_) {
+      return args.size() == 3 && std::holds_alternative<ComplexExpression>(args[0]) &&
+             std::holds_alternative<int64_t>(args[1]) &&
+             get<ComplexExpression>(args[0]).getHead() != "Top"_ &&
+             isJoinPlan(get<ComplexExpression>(args[0]));
+    }
+    return e.getHead() == "Select"_ && args.size() == 2 &&
+           std::holds_alternative<ComplexExpression>(args[0]) &&
+           get<ComplexExpression>(args[0]).getHead() != "Top"_ &&
+           isJoinPlan(get<ComplexExpression>(args[0])) &&
+           (getEqualitySymbols(args[1]).has_value() || getGreaterThanNumber(args[1]).has_value());
+  }
+
+  /**
+   * @brief Checks that each column of the tables below a join holds values of a single type.
+   *
+   * The columns of the helper are typed: a join on a list mixing int64_t and double values is left
+   * to the next engine (which compares the values one by one).
+   */
+  static bool hasTypedColumns(ComplexExpression const& e) {
+    auto const& args = e.getDynamicArguments();
+    if(e.getHead() == "Join"_) {
+      return std::all_of(args.begin(), args.end(), [](auto const& arg) {
+        return !std::holds_alternative<ComplexExpression>(arg) ||
+               hasTypedColumns(get<ComplexExpression>(arg));
+      });
+    }
+    if(e.getHead() != "Table"_) {
+      return true;
+    }
+    return std::all_of(args.begin(), args.end(), [](auto const& columnExpr) {
+      if(!std::holds_alternative<ComplexExpression>(columnExpr)) {
+        return true;
+      }
+      auto const& lists = get<ComplexExpression>(columnExpr).getDynamicArguments();
+      return lists.empty() || !std::holds_alternative<ComplexExpression>(lists.front()) ||
+             isSingleTyped(get<ComplexExpression>(lists.front()));
+    });
+  }
+
+  /**
+   * @brief Checks that the join keys of each join of a plan have the same type (or that one of
+   * them is empty).
+   *
+   * An int64_t column and a double column are compared numerically by the next engine: the plans
+   * joining them are left to it.
+   */
+  static bool joinKeysHaveSameType(ComplexExpression const& join) {
+    auto const& args = join.getDynamicArguments();
+    for(size_t i = 0; i < std::min<size_t>(args.size(), 2); i++) {
+      if(std::holds_alternative<ComplexExpression>(args[i]) &&
+         get<ComplexExpression>(args[i]).getHead() == "Join"_ &&
+         !joinKeysHaveSameType(get<ComplexExpression>(args[i]))) {
+        return false;
+      }
+    }
+    auto const symbols = args.size() == 3 ? getEqualitySymbols(args[2]) : std::nullopt;
+    if(!symbols) {
+      return true;
+    }
+    auto const* lhs = findColumnList(join, symbols->first);
+    auto const* rhs = findColumnList(join, symbols->second);
+    if(lhs == nullptr || rhs == nullptr) {
+      return true;
+    }
+    auto const lhsIsDouble = isDoubleList(*lhs);
+    auto const rhsIsDouble = isDoubleList(*rhs);
+    return !lhsIsDouble || !rhsIsDouble || *lhsIsDouble == *rhsIsDouble;
+  }
+
+  /// the list of values of a column of the tables below a join (nullptr if there is none)
+  static ComplexExpression const* findColumnList(ComplexExpression const& e, Symbol const& name) {
+    auto const& args = e.getDynamicArguments();
+    if(e.getHead() == "Join"_) {
+      for(size_t i = 0; i < std::min<size_t>(args.size(), 2); i++) {
+        if(std::holds_alternative<ComplexExpression>(args[i])) {
+          if(auto const* list = findColumnList(get<ComplexExpression>(args[i]), name)) {
+            return list;
+          }
+        }
+      }
+      return nullptr;
+    }
+    if(e.getHead() != "Table"_) {
+      return nullptr;
     }
+    for(auto const& columnExpr : args) {
+      if(!std::holds_alternative<ComplexExpression>(columnExpr)) {
+        continue;
+      }
+      auto const& column = get<ComplexExpression>(columnExpr);
+      auto const& lists = column.getDynamicArguments();
+      if(column.getHead() == name && !lists.empty() &&
+         std::holds_alternative<ComplexExpression>(lists.front())) {
+        return &get<ComplexExpression>(lists.front());
+      }
+    }
+    return nullptr;
+  }
+
+  /// whether the values of a (single-typed) list are double values (none if it is empty)
+  static std::optional<bool> isDoubleList(ComplexExpression const& list) {
+    auto const& values = list.getDynamicArguments();
+    if(!values.empty()) {
+      return std::holds_alternative<double_t>(values.front());
+    }
+    for(auto const& span : list.getSpanArguments()) {
+      auto const isDouble = std::visit(
+          [](auto const& typedSpan) -> std::optional<bool> {
+            using T =
+                std::remove_const_t<typename std::decay_t<decltype(typedSpan)>::element_type>;
+            if(typedSpan.size() == 0) {
+              return {};
+            }
+            return std::is_same_v<T, double_t>;
+          },
+          span);
+      if(isDouble) {
+        return isDouble;
+      }
+    }
+    return {};
+  }
+
+  /// checks that the numbers of a list are either all int64_t values or all double values
+  static bool isSingleTyped(ComplexExpression const& list) {
+    std::optional<bool> isDouble; // (the type of the first number)
+    auto const sameType = [&isDouble](bool valueIsDouble) {
+      if(!isDouble) {
+        isDouble = valueIsDouble;
+      }
+      return *isDouble == valueIsDouble;
+    };
+    auto const& values = list.getDynamicArguments();
+    auto const& spans = list.getSpanArguments();
+    return std::all_of(values.begin(), values.end(),
+                       [&sameType](auto const& value) {
+                         return sameType(std::holds_alternative<double_t>(value));
+                       }) &&
+           std::all_of(spans.begin(), spans.end(), [&sameType](auto const& span) {
+             return sameType(std::visit(
+                 [](auto const& typedSpan) {
+                   using T = std::remove_const_t<
+                       typename std::decay_t<decltype(typedSpan)>::element_type>;
+                   return std::is_same_v<T, double_t>;
+                 },
+                 span));
+           });
   }
 
+
   std::tuple<std::vector<Schema>, std::vector<Table>, std::vector<size_t>>
   getInputsFromPlan(Expression&& expr) {
     return std::visit(
@@ -123,23 +762,78 @@ public:
   }
 
   std::vector<Table> const& getInputs() { return inputs; }
+  /// the column names of each input table (in the same order as the inputs)
+  std::vector<Schema> const& getInputSchemas() { return inputSchemas; }
   std::vector<std::pair<size_t, size_t>> const& getJoinAttributeIndices() {
     return joinAttributeIndices;
   }
+  /// the equality predicates (from selections above the join) to evaluate during the join
+  std::vector<CyclicPredicate> const& getCyclicPredicates() { return cyclicPredicates; }
+  /// the selections on scores, that the result rows must pass (they are also applied on the result)
+  std::vector<ScoreThreshold> const& getScoreThresholds() { return scoreThresholds; }
+  /**
+   * the top rows to keep, if the join can choose them (the Top is applied on the result: the join
+   * may output more rows than these, but must output all of them)
+   */
+  std::optional<TopScores> const& getTopScores() { return topScores; }
 
-  void appendOutput(Table::value_type resultTuple) {
-    if(result.size() != resultTuple.size())
-      for(auto& it : resultTuple) {
-        std::visit(
-            [this](auto&& it) { result.emplace_back(std::vector<std::decay_t<decltype(it)>>()); },
-            it);
+  /**
+   * Keeps only the given rows of each input, e.g., after dropping the rows that cannot join. The
+   * row ids of the output refer to the filtered inputs: this must be called before appending any.
+   *
+   * @param rowsToKeep For each input, the (ascending) indices of the rows to keep.
+   */
+  void filterInputs(std::vector<std::vector<size_t>> const& rowsToKeep) {
+    if(rowsToKeep.size() != inputs.size()) {
+      throw std::runtime_error("expected one row id vector per input table");
+    }
+    if(!result.empty() || !outputRowIds.empty() || !factorizedOutputRowIds.empty()) {
+      throw std::runtime_error("cannot filter the inputs after appending output");
+    }
+    for(size_t t = 0; t < inputs.size(); t++) {
+      if(rowsToKeep[t].size() == getNumRows(inputs[t])) {
+        continue; // nothing to drop: keep sharing the original storage
       }
-    for(auto i = 0U; i < resultTuple.size(); i++)
-      std::visit([i, this](auto value, auto& columnVector) { columnVector.push_back(value); },
-                 resultTuple[i], result[i]);
-  };
+      for(auto& column : inputs[t]) {
+        column = std::visit(
+            [&rows = rowsToKeep[t]](auto const& typedColumn) -> Column {
+              using T = typename std::decay_t<decltype(typedColumn)>::value_type;
+              std::vector<T> kept(rows.size());
+              for(size_t i = 0; i < rows.size(); i++) {
+                kept[i] = typedColumn[rows[i]];
+              }
+              return TypedColumn<T>(std::move(kept));
+            },
+            column);
+      }
+    }
+  }
 
-  auto getResult() {
+  /**
+   * Appends a batch of result rows, given as one vector of row indices per input table:
+   * the r-th result row is made of the rows rowIds[0][r], rowIds[1][r], ... of the inputs.
+   * The values are only gathered (in bulk) when getResult() is called.
+   */
+  void appendOutputRowIds(RowIds&& rowIds) {
+    if(rowIds.size() != inputs.size()) {
+      throw std::runtime_error("expected one row id vector per input table");
+    }
+    outputRowIds.emplace_back(std::move(rowIds));
+  }
+
+  /**
+   * Appends a batch of result rows in factorized form (with a level for each input table): they
+   * are only flattened when getResult() is called.
+   */
+  void appendFactorizedOutputRowIds(FactorizedRowIds&& rowIds) {
+    if(rowIds.levels.size() != inputs.size()) {
+      throw std::runtime_error("expected one level per input table");
+    }
+    factorizedOutputRowIds.emplace_back(std::move(rowIds));
+  }
+
+  ComplexExpression getResult() {
+    materializeOutputRowIds();
     auto columns = ExpressionArguments();
     auto resultIt = std::move_iterator(result.begin());
     for(auto&& columnName : mergedSchema) {
@@ -157,7 +851,16 @@ public:
       columns.emplace_back(
           boss::expressions::ComplexExpression(Symbol(std::move(columnName)), std::move(args)));
     }
-    return ComplexExpression("Table"_, {}, std::move(columns));
+    auto table = ComplexExpression("Table"_, {}, std::move(columns));
+    for(auto&& selection : residualSelections) {
+      table = "Select"_(std::move(table), std::move(selection));
+    }
+    residualSelections.clear();
+    if(top) {
+      table = "Top"_(std::move(table), top->first, std::move(top->second));
+      top.reset();
+    }
+    return table;
   }
 };
 } // namespace simplificationLayer
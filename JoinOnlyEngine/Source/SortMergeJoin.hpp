@@ -0,0 +1,224 @@
+#pragma once
+
+#include "JoinOrder.hpp"
+#include "SimplificationLayer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace boss::engines::joinonly {
+using std::vector;
+
+/// the number of bits sorted by each pass of the radix sort
+constexpr unsigned radixBits = 8;
+constexpr size_t radixBuckets = size_t(1) << radixBits;
+
+/**
+ * @brief Computes the permutation that sorts integer keys, with an LSD radix sort.
+ *
+ * The (key, row id) pairs are sorted one byte at a time, from the least significant one: this is
+ * linear in the number of rows, whatever the order of the input (e.g., already sorted IDs) and
+ * the number of duplicates. The passes on bytes that are the same in all keys are skipped.
+ *
+ * @return The row ids in the order of their keys (stable for equal keys).
+ */
+inline vector<size_t> sortPermutation(int64_t const* keys, size_t n) {
+  // flip the sign bit so that the unsigned order is the signed order
+  auto const toUnsigned = [](int64_t key) {
+    return static_cast<uint64_t>(key) ^ (uint64_t(1) << 63); // NOLINT(readability-magic-numbers)
+  };
+  constexpr unsigned passes = 64 / radixBits;
+  // the histograms of all the passes, in a single read of the keys
+  vector<vector<size_t>> histograms(passes, vector<size_t>(radixBuckets, 0));
+  for(size_t i = 0; i < n; i++) {
+    auto bits = toUnsigned(keys[i]);
+    for(unsigned pass = 0; pass < passes; pass++) {
+      histograms[pass][(bits >> (pass * radixBits)) & (radixBuckets - 1)]++;
+    }
+  }
+  vector<uint64_t> sortedKeys(n);
+  vector<size_t> permutation(n);
+  for(size_t i = 0; i < n; i++) {
+    sortedKeys[i] = toUnsigned(keys[i]);
+    permutation[i] = i;
+  }
+  vector<uint64_t> scatteredKeys(n);
+  vector<size_t> scatteredIds(n);
+  for(unsigned pass = 0; pass < passes; pass++) {
+    auto& histogram = histograms[pass];
+    auto const shift = pass * radixBits;
+    if(std::find(histogram.begin(), histogram.end(), n) != histogram.end()) {
+      continue; // all the keys have the same byte
+    }
+    size_t position = 0;
+    for(auto& count : histogram) {
+      auto bucketSize = count;
+      count = position;
+      position += bucketSize;
+    }
+    for(size_t i = 0; i < n; i++) {
+      auto& target = histogram[(sortedKeys[i] >> shift) & (radixBuckets - 1)];
+      scatteredKeys[target] = sortedKeys[i];
+      scatteredIds[target] = permutation[i];
+      target++;
+    }
+    std::swap(sortedKeys, scatteredKeys);
+    std::swap(permutation, scatteredIds);
+  }
+  return permutation;
+}
+
+/**
+ * @brief Computes the permutation that sorts floating-point keys, with a comparison sort.
+ *
+ * @return The row ids in the order of their keys (NaNs, which never match, last).
+ */
+inline vector<size_t> sortPermutation(double_t const* keys, size_t n) {
+  vector<std::pair<double_t, size_t>> pairs(n);
+  for(size_t i = 0; i < n; i++) {
+    pairs[i] = {keys[i], i};
+  }
+  std::sort(pairs.begin(), pairs.end(), [](auto const& lhs, auto const& rhs) {
+    if(std::isnan(lhs.first)) {
+      return false;
+    }
+    return std::isnan(rhs.first) || lhs.first < rhs.first;
+  });
+  vector<size_t> permutation(n);
+  for(size_t i = 0; i < n; i++) {
+    permutation[i] = pairs[i].second;
+  }
+  return permutation;
+}
+
+/**
+ * Keys sorted in ascending order, along with the id of each of them (its position before sorting).
+ *
+ * Keys that are sorted already are not copied: they must then outlive their SortedKeys.
+ */
+template <typename Key> class SortedKeys {
+public:
+  /// keys sorted already (e.g., IDs)
+  SortedKeys(Key const* sortedKeys, size_t size) : keys(sortedKeys), size(size), ids(size) {
+    std::iota(ids.begin(), ids.end(), 0);
+  }
+  /// keys in the order of a permutation (copied in that order)
+  SortedKeys(Key const* unsortedKeys, vector<size_t>&& permutation)
+      : size(permutation.size()), ids(std::move(permutation)), sortedCopy(size) {
+    for(size_t i = 0; i < size; i++) {
+      sortedCopy[i] = unsortedKeys[ids[i]];
+    }
+    keys = sortedCopy.data();
+  }
+  SortedKeys(SortedKeys const&) = delete; // (keys may point to sortedCopy)
+  SortedKeys& operator=(SortedKeys const&) = delete;
+  SortedKeys(SortedKeys&&) noexcept = default; // (a moved vector keeps its elements in place)
+  SortedKeys& operator=(SortedKeys&&) noexcept = default;
+  ~SortedKeys() = default;
+
+  Key const* keys = nullptr;
+  size_t size;
+  vector<size_t> ids;
+
+private:
+  vector<Key> sortedCopy;
+};
+
+/**
+ * @brief Checks if keys are in ascending order (without NaNs, which are not ordered).
+ */
+template <typename Key> bool isSorted(Key const* keys, size_t size) {
+  for(size_t i = 1; i < size; i++) {
+    if(!(keys[i - 1] <= keys[i])) {
+      return false;
+    }
+  }
+  if constexpr(std::is_floating_point_v<Key>) {
+    return size == 0 || !std::isnan(keys[0]);
+  } else {
+    return true;
+  }
+}
+
+/**
+ * @brief Sorts keys (unless they are sorted already), keeping track of where each comes from.
+ *
+ * The keys are copied once at most: only if they need sorting, in their sorted order.
+ *
+ * @param keys The keys to sort, e.g., the values of a join attribute (and nothing else).
+ */
+template <typename Key> SortedKeys<Key> sortKeys(Key const* keys, size_t size) {
+  if(isSorted(keys, size)) {
+    return SortedKeys<Key>(keys, size); // e.g., IDs: nothing to sort
+  }
+  return SortedKeys<Key>(keys, sortPermutation(keys, size));
+}
+
+/**
+ * @brief Merges two sorted key arrays and calls `match` for each pair of ids with equal keys.
+ *
+ * Duplicates are handled by degrading to a nested-loop iteration over the two runs of equal keys,
+ * giving their cartesian product.
+ *
+ * @tparam Key The type of the join attributes on both sides.
+ * @param left The sorted keys of the left side.
+ * @param right The sorted keys of the right side.
+ * @param match Called with the left id and the right id of every matching pair.
+ */
+template <typename Key, typename F>
+void mergeJoin(SortedKeys<Key> const& left, SortedKeys<Key> const& right, F&& match) {
+  size_t left_cursor = 0;
+  size_t right_cursor = 0;
+  // -- Begin while there are still rows to join --
+  while(left_cursor < left.size && right_cursor < right.size) {
+    auto const& left_key = left.keys[left_cursor];
+    auto const& right_key = right.keys[right_cursor];
+    if(left_key < right_key) {
+      left_cursor++;
+    } else if(right_key < left_key) {
+      right_cursor++;
+    } else if(left_key == right_key) {
+      // find the runs of duplicates on both sides, and output their cartesian product
+      size_t left_end = left_cursor + 1;
+      while(left_end < left.size && left.keys[left_end] == left_key) {
+        left_end++;
+      }
+      size_t right_end = right_cursor + 1;
+      while(right_end < right.size && right.keys[right_end] == right_key) {
+        right_end++;
+      }
+      for(auto l = left_cursor; l < left_end; l++) {
+        for(auto r = right_cursor; r < right_end; r++) {
+          match(left.ids[l], right.ids[r]);
+        }
+      }
+      left_cursor = left_end;
+      right_cursor = right_end;
+    } else {
+      // unordered values (NaN) never match: they are sorted last, so nothing else can match
+      break;
+    }
+  } // -- End while there are still rows to join --
+}
+
+/**
+ * @brief Joins probe keys with a build column by sorting both sides and merging them.
+ *
+ * @return The matches, as (index in probeKeys, row of buildColumn) pairs.
+ */
+template <typename Key>
+simplificationLayer::StepMatches
+sortMergeJoinMatches(simplificationLayer::TypedColumn<Key> const& buildColumn,
+                     vector<Key> const& probeKeys) {
+  simplificationLayer::StepMatches matches;
+  auto const probe = sortKeys(probeKeys.data(), probeKeys.size());
+  auto const build = sortKeys(buildColumn.data(), buildColumn.size());
+  mergeJoin(probe, build, [&](size_t probeId, size_t buildId) {
+    matches.partialIndices.push_back(probeId);
+    matches.rows.push_back(buildId);
+  });
+  return matches;
+}
+
+} // namespace boss::engines::joinonly
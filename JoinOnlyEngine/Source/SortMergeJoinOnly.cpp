@@ -1,180 +1,86 @@
 #include "SortMergeJoinOnly.hpp"
 #include "Common.hpp"
 
+#include "SemiJoinReduction.hpp"
+#include "SortMergeJoin.hpp"
 #include "SimplificationLayer.hpp"
 #include <Algorithm.hpp>
 #include <Expression.hpp>
 #include <ExpressionUtilities.hpp>
 #include <Utilities.hpp>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <mutex>
+#include <numeric>
 #include <variant>
 #include <vector>
 
-namespace boss::engines::joinonly {
+using boss::utilities::operator""_;
+
+namespace boss::engines::joinonly::sortmergejoinonly {
 using std::vector;
 
 /**
- * @brief Partitions a Table based on a pivot value from a specified column.
- *
- * This function takes a Table and partitions it based on the values in the
- * `sort_index`. It uses the Hoare partition scheme
- * (see https://en.wikipedia.org/wiki/Quicksort#Hoare_partition_scheme),
- * choosing a pivot from the middle of the range. The elements less than the
- * pivot are moved to the left, and those greater are moved to the right.
- *
- * @param table The table to be partitioned must be non const.
- * @param sort_index The index of the column used for partitioning.
- * @param start The starting index of the range to partition (INCLUSIVE).
- * @param end The ending index of the range to partition (INCLUSIVE).
- * @return The final index of the pivot element after partitioning.
+ * @brief Keeps only the partial results that satisfy the predicates closing cycles at a table.
  *
- * @note The partition is done in-place, modifying the original vector
- *       so must be mutable.
- * @warning The function assumes that the values in the sort column support
- *          the comparison operators (< and >).
+ * @param result_rows The partial results (one vector of row ids per input table), filtered in-place.
+ * @param input The input tables.
+ * @param cyclic_predicates The predicates closing cycles (from selections above the join).
+ * @param table The table just joined: the predicates between it and earlier tables are checked.
  */
-size_t partitionTable(vector<simplificationLayer::Column>& table, size_t sort_index, size_t start,
-                      size_t end) {
-  std::vector<simplificationLayer::Value> const& pivot_column = table[sort_index];
-  size_t COLUMN_COUNT = table.size();
-  size_t pivot_index = start + (end - start) / 2;
-  simplificationLayer::Value pivot_value = pivot_column[pivot_index];
-  size_t i = start - 1;
-  size_t j = end + 1;
-  while(1) {
-    // Get swap points
-    do {
-      i++;
-    } while(pivot_column[i] < pivot_value);
-    do {
-      j--;
-    } while(pivot_column[j] > pivot_value);
-
-    if(i >= j) {
-      return j;
+inline void keepRowsClosingCycles(simplificationLayer::RowIds& result_rows,
+                                  vector<simplificationLayer::Table> const& input,
+                                  vector<simplificationLayer::CyclicPredicate> const& cyclic_predicates,
+                                  size_t table) {
+  for(auto const& [lhs, rhs] : cyclic_predicates) {
+    if(rhs.table != table) {
+      continue;
     }
-    // Swap rows
-    for(size_t columnIndex = 0; columnIndex < COLUMN_COUNT; columnIndex++) {
-      simplificationLayer::Value temp = table[columnIndex][i];
-      table[columnIndex][i] = table[columnIndex][j];
-      table[columnIndex][j] = temp;
+    auto const& lhs_column = input[lhs.table][lhs.column];
+    auto const& rhs_column = input[rhs.table][rhs.column];
+    size_t kept = 0;
+    for(size_t r = 0; r < result_rows[table].size(); ++r) {
+      if(simplificationLayer::valuesEqual(lhs_column, result_rows[lhs.table][r], rhs_column,
+                                          result_rows[rhs.table][r])) {
+        for(size_t t = 0; t <= table; ++t) {
+          result_rows[t][kept] = result_rows[t][r];
+        }
+        kept++;
+      }
     }
-  }
-}
-
-/**
- * @brief Sorts a vector of columns in ascending order based on a specified column index.
- *
- * This function implements the Quicksort algorithm to sort a table. It
- * recursively partitions the table based on the values in the specified sort_index
- * column. The partitioning is done in-place, modifying the original vector.
- *
- * @param table The table to be sorted.
- * @param sort_index The index of the column used for sorting.
- * @param start The starting index of the range to be sorted.
- * @param end The ending index of the range to be sorted.
- *
- * @note The sorting is done in-place, modifying the original vector.
- * @warning The function assumes that the values in the specified columns support
- *          the comparison operators (< and >).
- * @warning The function does not check if start and end indices are within the valid
- *          range. Specifically to sort a whole vector the end index
- *          should be set to vector.size() - 1.
- */
-void quicksortTable(vector<simplificationLayer::Column>& table, size_t sort_index, size_t start,
-                    size_t end) {
-  if(start >= 0 && end >= 0 && start < end) {
-    int pivot_index = partitionTable(table, sort_index, start, end);
-    quicksortTable(table, sort_index, start, pivot_index);
-    quicksortTable(table, sort_index, pivot_index + 1, end);
-  }
-}
-
-/**
- * @brief Outputs rows one by one from a table in column-store form.
- *
- * This function takes a JoinHelper object and a table in column-store form and outputs
- * the rows one by one.
- *
- * @param helper The JoinHelper responsible for pushing the data to the next stage in the pipeline.
- * @param result_table The vector of column vectors representing the table in column-store form.
- *
- * @note The function assumes that the input table is well-formed and has consistent column lengths.
- */
-inline void outputRows(simplificationLayer::JoinHelper& helper,
-                       const vector<vector<simplificationLayer::Value>>& result_table) {
-  for(int i = 0; i < result_table[0].size(); ++i) {
-    std::__1::vector<simplificationLayer::Value> resultRow;
-    for(int j = 0; j < result_table.size(); ++j) {
-      resultRow.push_back(result_table[j][i]);
+    for(size_t t = 0; t <= table; ++t) {
+      result_rows[t].resize(kept);
     }
-    helper.appendOutput(resultRow);
   }
 }
 
-/**
- * @brief Handles a match during a join operation by populating the result table.
- *
- * This function is responsible for handling a match between values in the left and right tables
- * during a join.
- * It keeps track of duplicates in both tables ensuring that the cartesian product is given for
- * the set of rows that match.
- *
- * @param result_table The vector of columns representing the result table.
- * @param left_table The vector of columns representing the left table in column-store form.
- * @param right_table The vector of columns representing the right table.
- * @param left_index The index of the column in the left table used for matching.
- * @param right_index The index of the column in the right table used for matching.
- * @param left_cursor The cursor indicating the current position in the left table.
- * @param right_cursor The cursor indicating the current position in the right table.
- * @param lv The current value in the left table used for matching.
- * @param rv The current value in the right table used for matching.
- *
- * @note The function returns with all matching tuples added and the left and right cursors avanced
- * to the next unique value.
- *
- * @warning The function may return cursors that are out of bounds of the table.
- */
-inline void handleJoinMatch(vector<vector<simplificationLayer::Value>>& result_table,
-                            vector<vector<std::variant<long, double>>>& left_table,
-                            vector<simplificationLayer::Column>& right_table, size_t left_index,
-                            size_t right_index, size_t& left_cursor, size_t& right_cursor,
-                            simplificationLayer::Value lv, const simplificationLayer::Value rv) {
-  size_t old_right_cursor = right_cursor;
-  size_t right_duplicate_count = 0;
-
-  while(lv == rv) {
-    do {
-      for(int j = 0; j < left_table.size(); ++j) {
-        result_table[j].push_back(left_table[j][left_cursor]);
-      }
-      for(int j = 0; j < right_table.size(); ++j) {
-        result_table[j + left_table.size()].push_back(right_table[j][right_cursor]);
-      }
-    } while(right_table[0].size() > ++right_cursor && right_table[right_index][right_cursor] == lv);
-    left_cursor++;
-    right_duplicate_count = right_cursor - old_right_cursor;
-    right_cursor = old_right_cursor;
-    if(left_cursor >= left_table[0].size()) {
-      break;
+class Engine {
+  /// whether to drop the dangling rows of the inputs (with semi-joins) before joining them
+  bool semiJoinReduction = false;
+
+  /**
+   * @brief Changes the configuration of the engine, e.g., "Set"_("SemiJoinReduction"_, 1).
+   *
+   * @return false if the option is not one of this engine's.
+   */
+  bool setOption(Symbol const& option, int64_t value) {
+    if(option == "SemiJoinReduction"_) {
+      semiJoinReduction = value != 0;
+      return true;
     }
-    lv = left_table[left_index][left_cursor];
+    return false;
   }
-  right_cursor = old_right_cursor + right_duplicate_count;
-  // now either they have stopped matching
-  // Or we got to the end of the left table -> continue and we will exit the loop
-  // both left_cursor and right_cursor should be pointing to the next unique value
-  // if it exists
-}
 
-class Engine {
   simplificationLayer::JoinHelper performMultiwayJoin(simplificationLayer::JoinHelper&& helper) {
 
     ////////////////////////////////////////////////////////////////////////////////
     ///////////////////////////// Your code starts here ////////////////////////////
     ////////////////////////////////////////////////////////////////////////////////
 
+    if(semiJoinReduction) {
+      simplificationLayer::semiJoinReduce(helper);
+    }
     auto const& input = helper.getInputs();
     std::vector<std::pair<size_t, size_t>> const& join_attribute_indices =
         helper.getJoinAttributeIndices();
@@ -183,69 +89,45 @@ class Engine {
 
     size_t const num_join_attributes = join_attribute_indices.size();
 
-    // How much to offset the Left table (since it will contain columns which it has already been
-    // joined on)
-    size_t column_offset = 0;
-    //    Stores the results of the join
-    std::vector<vector<simplificationLayer::Value>> builder_table;
-    std::vector<vector<simplificationLayer::Value>> result_table;
-    bool first = true;
+    // The rows of the inputs joined so far, as one vector of row ids per input table (the tables
+    // not joined yet have none). No value is copied until the helper gathers the final result.
+    simplificationLayer::RowIds result_rows(input.size());
+    result_rows[0].resize(simplificationLayer::getNumRows(input[0]));
+    std::iota(result_rows[0].begin(), result_rows[0].end(), 0);
     // -- Begin for each join attribute --
     for(size_t i = 0; i < num_join_attributes; i++) {
-      size_t left_cursor = 0;
-      size_t right_cursor = 0;
-      builder_table = result_table;
-
-      vector<vector<std::variant<long, double>>> left_table = first ? input[0] : builder_table;
-      first = false;
-      vector<simplificationLayer::Column> right_table = input[i + 1];
-      //  build empty results table
-      result_table.clear();
-      for(int j = 0; j < left_table.size() + right_table.size(); j++) {
-        result_table.push_back(vector<simplificationLayer::Value>());
-      }
+      simplificationLayer::RowIds next_rows(input.size());
       std::pair<size_t, size_t> const& join_attribute_index = join_attribute_indices[i];
-      size_t left_index = join_attribute_index.first + column_offset;
-      size_t right_index = join_attribute_index.second; // no offset needed
-      //        Sort both tables by the join attribute
-      quicksortTable(left_table, left_index, 0, left_table[0].size() - 1);
-      quicksortTable(right_table, right_index, 0, right_table[0].size() - 1);
-
-      simplificationLayer::Value lv = left_table[left_index][left_cursor];
-      simplificationLayer::Value rv = right_table[right_index][right_cursor];
-      // -- Begin while there are still rows to join --
-      while(right_cursor < right_table[0].size() && left_cursor < left_table[0].size()) {
-        rv = right_table[right_index][right_cursor];
-        lv = left_table[left_index][left_cursor];
-
-        while(lv > rv) {
-          right_cursor++;
-          if(right_cursor >= right_table[0].size()) {
-            break;
-          }
-          rv = right_table[right_index][right_cursor];
-        }
-
-        while(rv > lv) {
-          left_cursor++;
-          if(left_cursor >= left_table[0].size()) {
-            break;
-          }
-          lv = left_table[left_index][left_cursor];
-        }
-        if(lv == rv) {
-          //  We now have to degrade to a nested loop style iteration to cope with duplicates
-          handleJoinMatch(result_table, left_table, right_table, left_index, right_index,
-                          left_cursor, right_cursor, lv, rv);
-        }
-      } // -- End while there are still rows to join --
-
-      // The next table will join on the right table. but the right tables collum indexes will be
-      // offset by the size of the left table
-      column_offset += left_table.size();
+      // dispatch on the types of the join attributes once per join
+      // (values of different types never match, leaving the result empty)
+      simplificationLayer::visitSameTypeColumns(
+          input[i][join_attribute_index.first], input[i + 1][join_attribute_index.second],
+          [&](auto const& left_column, auto const& right_column) {
+            using Key = typename std::decay_t<decltype(left_column)>::value_type;
+            // Sort only the join attribute of both sides (and the ids of the rows):
+            // the left side is the join attribute of table i in each partial result
+            vector<Key> left_keys(result_rows[i].size());
+            for(size_t r = 0; r < left_keys.size(); ++r) {
+              left_keys[r] = left_column[result_rows[i][r]];
+            }
+            auto const left = sortKeys(left_keys.data(), left_keys.size());
+            auto const right = sortKeys(right_column.data(), right_column.size());
+            mergeJoin(left, right, [&](size_t left_id, size_t right_id) {
+              for(size_t t = 0; t <= i; ++t) {
+                next_rows[t].push_back(result_rows[t][left_id]);
+              }
+              next_rows[i + 1].push_back(right_id);
+            });
+          });
+      result_rows = std::move(next_rows);
+      // Drop the rows that do not close the cycles completed by this join (as early as possible)
+      keepRowsClosingCycles(result_rows, input, helper.getCyclicPredicates(), i + 1);
+      if(result_rows[i + 1].empty()) {
+        break; // nothing left to join
+      }
     }; // -- End for each join attribute --
 
-    outputRows(helper, result_table);
+    helper.appendOutputRowIds(std::move(result_rows));
     ////////////////////////////////////////////////////////////////////////////////
     ////////////////////////////// Your code ends here /////////////////////////////
     ////////////////////////////////////////////////////////////////////////////////
@@ -258,7 +140,14 @@ public:
     try {
       return visit(boss::utilities::overload(
                        [this](ComplexExpression&& e) -> Expression {
-                         if(e.getHead().getName() == "Join") {
+                         auto const& args = e.getDynamicArguments();
+                         if(e.getHead() == "Set"_ && args.size() == 2 &&
+                            std::holds_alternative<Symbol>(args[0]) &&
+                            std::holds_alternative<int64_t>(args[1]) &&
+                            setOption(get<Symbol>(args[0]), get<int64_t>(args[1]))) {
+                           return true;
+                         }
+                         if(simplificationLayer::JoinHelper::isJoinPlan(e)) {
                            return performMultiwayJoin(simplificationLayer::JoinHelper(std::move(e)))
                                .getResult();
                          } else {
@@ -284,12 +173,14 @@ public:
   }
 };
 
-} // namespace boss::engines::joinonly
+} // namespace boss::engines::joinonly::sortmergejoinonly
+
+using boss::engines::joinonly::sortmergejoinonly::Engine;
 
 static auto& enginePtr(bool initialise = true) {
-  static auto engine = std::unique_ptr<boss::engines::joinonly::Engine>();
+  static auto engine = std::unique_ptr<Engine>();
   if(!engine && initialise) {
-    engine.reset(new boss::engines::joinonly::Engine());
+    engine.reset(new Engine());
   }
   return engine;
 }
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace boss::engines::joinonly {
+
+/**
+ * A pool of worker threads to run a loop over tasks (e.g., the morsels of a probe table) in
+ * parallel.
+ *
+ * The tasks of a loop are split into one contiguous range per worker, that the worker processes in
+ * order. A worker that is done with its own range steals tasks from the ranges of the others, so
+ * that the load stays balanced even if the tasks have very different costs (e.g., skewed joins).
+ *
+ * The calling thread takes part as worker 0: a pool of size 1 has no threads and runs everything
+ * on the caller.
+ */
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t numWorkers) : ranges(std::max<size_t>(numWorkers, 1)) {
+    threads.reserve(ranges.size() - 1);
+    for(size_t worker = 1; worker < ranges.size(); worker++) {
+      threads.emplace_back([this, worker]() { work(worker); });
+    }
+  }
+
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+  ThreadPool(ThreadPool&&) = delete;
+  ThreadPool& operator=(ThreadPool&&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> const lock(mutex);
+      stopping = true;
+    }
+    wakeUp.notify_all();
+    for(auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  /// the number of workers (including the calling thread)
+  size_t size() const { return ranges.size(); }
+
+  /**
+   * @brief Calls f(task, worker) for every task in [0, numTasks), in parallel.
+   *
+   * Each worker index is used by one thread at a time, so that f can write to per-worker state.
+   * Returns once all the tasks are done. If any task throws, the first exception is rethrown.
+   */
+  template <typename F> void parallelFor(size_t numTasks, F&& f) {
+    if(numTasks <= 1 || ranges.size() == 1) {
+      for(size_t task = 0; task < numTasks; task++) {
+        f(task, 0);
+      }
+      return;
+    }
+    auto const tasksPerWorker = (numTasks + ranges.size() - 1) / ranges.size();
+    for(size_t worker = 0; worker < ranges.size(); worker++) {
+      ranges[worker].next = std::min(worker * tasksPerWorker, numTasks);
+      ranges[worker].end = std::min((worker + 1) * tasksPerWorker, numTasks);
+    }
+    firstError = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(mutex);
+      loop = [&f](size_t task, size_t worker) { f(task, worker); };
+      busyWorkers = threads.size();
+      generation++;
+    }
+    wakeUp.notify_all();
+    runTasks(0);
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      done.wait(lock, [this]() { return busyWorkers == 0; });
+      loop = nullptr;
+    }
+    if(firstError) {
+      std::rethrow_exception(firstError);
+    }
+  }
+
+private:
+  /// the tasks of a worker that are not claimed yet: [next, end)
+  struct alignas(64) Range { // NOLINT(readability-magic-numbers): one cache line per range
+    std::atomic<size_t> next = 0;
+    size_t end = 0;
+  };
+
+  std::vector<Range> ranges;
+  std::vector<std::thread> threads;
+
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::condition_variable done;
+  std::function<void(size_t, size_t)> loop;
+  size_t generation = 0;
+  size_t busyWorkers = 0;
+  bool stopping = false;
+
+  std::mutex errorMutex;
+  std::exception_ptr firstError;
+
+  /// claims a task from the range of a worker (returns false if there is none left)
+  bool claim(Range& range, size_t& task) {
+    if(range.next.load(std::memory_order_relaxed) >= range.end) {
+      return false;
+    }
+    task = range.next.fetch_add(1, std::memory_order_relaxed);
+    return task < range.end;
+  }
+
+  void runTasks(size_t worker) {
+    auto runTask = [this, worker](size_t task) {
+      try {
+        loop(task, worker);
+      } catch(...) {
+        std::lock_guard<std::mutex> const lock(errorMutex);
+        if(!firstError) {
+          firstError = std::current_exception();
+        }
+      }
+    };
+    size_t task = 0;
+    // own tasks first
+    while(claim(ranges[worker], task)) {
+      runTask(task);
+    }
+    // then steal from the others
+    for(size_t i = 1; i < ranges.size(); i++) {
+      auto& victim = ranges[(worker + i) % ranges.size()];
+      while(claim(victim, task)) {
+        runTask(task);
+      }
+    }
+  }
+
+  void work(size_t worker) {
+    size_t seenGeneration = 0;
+    while(true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeUp.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+        if(stopping) {
+          return;
+        }
+        seenGeneration = generation;
+      }
+      runTasks(worker);
+      {
+        std::lock_guard<std::mutex> const lock(mutex);
+        busyWorkers--;
+      }
+      done.notify_one();
+    }
+  }
+};
+
+} // namespace boss::engines::joinonly
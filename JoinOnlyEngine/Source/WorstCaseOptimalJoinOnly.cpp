@@ -0,0 +1,394 @@
+#include "WorstCaseOptimalJoinOnly.hpp"
+#include "Common.hpp"
+
+#include "SimplificationLayer.hpp"
+#include <Algorithm.hpp>
+#include <Expression.hpp>
+#include <ExpressionUtilities.hpp>
+#include <Utilities.hpp>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+using boss::utilities::operator""_;
+
+namespace boss::engines::joinonly::worstcaseoptimaljoinonly {
+using std::vector;
+
+/**
+ * @brief Maps a key to an integer with the same order, so that int64_t and double keys are
+ * handled by the same (untyped) tries. Keys of different types are never compared.
+ */
+inline int64_t toOrderedKey(int64_t key) { return key; }
+inline int64_t toOrderedKey(double_t key) {
+  if(key == 0) {
+    key = 0; // -0.0 and 0.0 are equal
+  }
+  int64_t bits = 0;
+  std::memcpy(&bits, &key, sizeof(bits));
+  // negative doubles are ordered the other way around (sign-magnitude)
+  return bits < 0 ? bits ^ std::numeric_limits<int64_t>::max() : bits;
+}
+
+/**
+ * One input table as a trie over its join variables (in the global variable order), stored as
+ * sorted arrays: keys[level][i] is the value of variables[level] in the i-th row (in sorted
+ * order), so that the rows with the same values for the first variables are contiguous.
+ */
+struct SortedRelation {
+  vector<size_t> variables;
+  vector<vector<int64_t>> keys;
+  /// the row of the input table for each sorted row
+  vector<size_t> rowIds;
+};
+
+/**
+ * @brief Sorts a table on the columns of its join variables.
+ *
+ * @param columnsOfVariables The columns of the table that are bound to each of its variables
+ * (several columns bound to the same variable must have equal values: other rows are dropped).
+ */
+inline SortedRelation
+sortRelation(simplificationLayer::Table const& table,
+             vector<std::pair<size_t, vector<size_t>>> const& columnsOfVariables) {
+  auto const numRows = simplificationLayer::getNumRows(table);
+  SortedRelation relation;
+  vector<vector<int64_t>> keys;
+  vector<bool> isValid(numRows, true);
+  for(auto const& [variable, columns] : columnsOfVariables) {
+    relation.variables.push_back(variable);
+    auto& variableKeys = keys.emplace_back(numRows);
+    for(size_t c = 0; c < columns.size(); c++) {
+      std::visit(
+          [&, c](auto const& column) {
+            for(size_t row = 0; row < numRows; row++) {
+              if constexpr(std::is_floating_point_v<
+                               typename std::decay_t<decltype(column)>::value_type>) {
+                if(std::isnan(column[row])) {
+                  isValid[row] = false; // NaN never matches
+                  continue;
+                }
+              }
+              auto key = toOrderedKey(column[row]);
+              if(c == 0) {
+                variableKeys[row] = key;
+              } else if(variableKeys[row] != key) {
+                isValid[row] = false;
+              }
+            }
+          },
+          table[columns[c]]);
+    }
+  }
+  for(size_t row = 0; row < numRows; row++) {
+    if(isValid[row]) {
+      relation.rowIds.push_back(row);
+    }
+  }
+  std::sort(relation.rowIds.begin(), relation.rowIds.end(), [&keys](size_t lhs, size_t rhs) {
+    for(auto const& levelKeys : keys) {
+      if(levelKeys[lhs] != levelKeys[rhs]) {
+        return levelKeys[lhs] < levelKeys[rhs];
+      }
+    }
+    return lhs < rhs;
+  });
+  for(auto const& levelKeys : keys) {
+    auto& sortedKeys = relation.keys.emplace_back(relation.rowIds.size());
+    for(size_t i = 0; i < relation.rowIds.size(); i++) {
+      sortedKeys[i] = levelKeys[relation.rowIds[i]];
+    }
+  }
+  return relation;
+}
+
+/**
+ * Generic Join over sorted relations: binds one join variable at a time by intersecting the values
+ * of that variable in all the relations that have it (restricted to the rows matching the
+ * variables bound so far), and recursing for each value in the intersection.
+ *
+ * The intersection seeks (with binary searches) from the relation with the fewest candidate rows,
+ * leapfrogging over the values that are missing from any other relation. This bounds the work by
+ * the worst-case output size of the (cyclic) query, instead of by the size of the intermediate
+ * results of a sequence of binary joins.
+ */
+class GenericJoin {
+public:
+  GenericJoin(vector<SortedRelation> const& relations, size_t numVariables,
+              simplificationLayer::RowIds& output)
+      : relations(relations), output(output), participants(numVariables), ranges(relations.size()),
+        savedRanges(numVariables), cursors(numVariables), rows(relations.size()) {
+    for(size_t r = 0; r < relations.size(); r++) {
+      ranges[r] = {0, relations[r].rowIds.size()};
+      for(size_t level = 0; level < relations[r].variables.size(); level++) {
+        participants[relations[r].variables[level]].push_back({r, level});
+      }
+    }
+  }
+
+  void run() { join(0); }
+
+private:
+  struct Participant {
+    size_t relation;
+    size_t level;
+  };
+  using Range = std::pair<size_t, size_t>;
+
+  vector<SortedRelation> const& relations;
+  simplificationLayer::RowIds& output;
+  /// for each variable, the relations that have it (and the trie level it is at)
+  vector<vector<Participant>> participants;
+  /// for each relation, the rows matching the variables bound so far
+  vector<Range> ranges;
+  // scratch space for each variable (to avoid allocations in the recursion)
+  vector<vector<Range>> savedRanges;
+  vector<vector<size_t>> cursors;
+  vector<size_t> rows;
+
+  int64_t const* levelKeys(Participant const& participant) const {
+    return relations[participant.relation].keys[participant.level].data();
+  }
+
+  void join(size_t variable) {
+    if(variable == participants.size()) {
+      emit();
+      return;
+    }
+    auto const& variableParticipants = participants[variable];
+    // iterate over the values of the relation with the fewest candidate rows
+    auto const& smallest = *std::min_element(
+        variableParticipants.begin(), variableParticipants.end(),
+        [this](auto const& lhs, auto const& rhs) {
+          return ranges[lhs.relation].second - ranges[lhs.relation].first <
+                 ranges[rhs.relation].second - ranges[rhs.relation].first;
+        });
+    auto& saved = savedRanges[variable];
+    auto& cursor = cursors[variable];
+    saved.clear();
+    cursor.clear();
+    for(auto const& participant : variableParticipants) {
+      saved.push_back(ranges[participant.relation]);
+      cursor.push_back(ranges[participant.relation].first);
+    }
+    auto const* smallestKeys = levelKeys(smallest);
+    auto [i, end] = ranges[smallest.relation];
+    while(i < end) {
+      auto value = smallestKeys[i];
+      bool allMatch = true;
+      for(size_t p = 0; p < variableParticipants.size() && allMatch; p++) {
+        auto const& participant = variableParticipants[p];
+        if(participant.relation == smallest.relation) {
+          continue;
+        }
+        auto const* keys = levelKeys(participant);
+        auto const* lower =
+            std::lower_bound(keys + cursor[p], keys + saved[p].second, value);
+        cursor[p] = lower - keys;
+        if(cursor[p] == saved[p].second) {
+          // no larger value in this relation: the intersection is complete
+          i = end;
+          allMatch = false;
+        } else if(*lower != value) {
+          // leapfrog to the next value that this relation has
+          i = std::lower_bound(smallestKeys + i, smallestKeys + end, *lower) - smallestKeys;
+          allMatch = false;
+        } else {
+          ranges[participant.relation] = {
+              cursor[p], std::upper_bound(lower, keys + saved[p].second, value) - keys};
+        }
+      }
+      if(!allMatch) {
+        continue;
+      }
+      auto valueEnd = std::upper_bound(smallestKeys + i, smallestKeys + end, value) - smallestKeys;
+      ranges[smallest.relation] = {i, valueEnd};
+      join(variable + 1);
+      for(size_t p = 0; p < variableParticipants.size(); p++) {
+        ranges[variableParticipants[p].relation] = saved[p];
+      }
+      i = valueEnd;
+    }
+    for(size_t p = 0; p < variableParticipants.size(); p++) {
+      ranges[variableParticipants[p].relation] = saved[p];
+    }
+  }
+
+  /// outputs all the combinations of the rows matching the bound variables
+  void emit() {
+    for(size_t r = 0; r < relations.size(); r++) {
+      if(ranges[r].first == ranges[r].second) {
+        return;
+      }
+      rows[r] = ranges[r].first;
+    }
+    while(true) {
+      for(size_t r = 0; r < relations.size(); r++) {
+        output[r].push_back(relations[r].rowIds[rows[r]]);
+      }
+      auto r = relations.size();
+      while(r > 0 && ++rows[r - 1] == ranges[r - 1].second) {
+        rows[r - 1] = ranges[r - 1].first;
+        r--;
+      }
+      if(r == 0) {
+        return;
+      }
+    }
+  }
+};
+
+/**
+ * @brief Joins the inputs with a worst-case optimal join.
+ *
+ * The join attributes that are (transitively) equal form the join variables, numbered in the order
+ * they first appear in the predicates. Each input is sorted on its variables in that order and the
+ * variables are bound one at a time (see GenericJoin).
+ *
+ * @param equalities The pairs of attributes that must be equal: the join predicates of the plan
+ * and, possibly, predicates closing cycles.
+ * @return The result rows, as one vector of row indices per input table.
+ */
+inline simplificationLayer::RowIds
+worstCaseOptimalJoin(vector<simplificationLayer::Table> const& input,
+                     vector<simplificationLayer::CyclicPredicate> const& equalities) {
+  simplificationLayer::RowIds output(input.size());
+  // number the attributes: the columns of all the tables, one after the other
+  vector<size_t> tableOffsets(input.size() + 1, 0);
+  for(size_t t = 0; t < input.size(); t++) {
+    tableOffsets[t + 1] = tableOffsets[t] + input[t].size();
+  }
+  auto attributeId = [&tableOffsets](simplificationLayer::Attribute const& attribute) {
+    return tableOffsets[attribute.table] + attribute.column;
+  };
+  // union-find the attributes that are equal
+  auto const numAttributes = tableOffsets.back();
+  vector<size_t> parents(numAttributes);
+  std::iota(parents.begin(), parents.end(), 0);
+  std::function<size_t(size_t)> find = [&](size_t a) {
+    return parents[a] == a ? a : parents[a] = find(parents[a]);
+  };
+  vector<size_t> joinAttributes; // in the order they first appear
+  vector<bool> isJoinAttribute(numAttributes, false);
+  for(auto const& [lhs, rhs] : equalities) {
+    for(auto id : {attributeId(lhs), attributeId(rhs)}) {
+      if(!isJoinAttribute[id]) {
+        isJoinAttribute[id] = true;
+        joinAttributes.push_back(id);
+      }
+    }
+    parents[find(attributeId(lhs))] = find(attributeId(rhs));
+  }
+  // number the variables (the sets of equal attributes)
+  vector<size_t> variableOfRoot(numAttributes, numAttributes);
+  size_t numVariables = 0;
+  for(auto id : joinAttributes) {
+    if(variableOfRoot[find(id)] == numAttributes) {
+      variableOfRoot[find(id)] = numVariables++;
+    }
+  }
+  // collect the columns of each table bound to each variable (and check their types)
+  vector<std::optional<size_t>> variableTypes(numVariables);
+  vector<SortedRelation> relations;
+  for(size_t t = 0; t < input.size(); t++) {
+    vector<std::pair<size_t, vector<size_t>>> columnsOfVariables;
+    for(size_t c = 0; c < input[t].size(); c++) {
+      auto id = tableOffsets[t] + c;
+      if(!isJoinAttribute[id]) {
+        continue;
+      }
+      auto variable = variableOfRoot[find(id)];
+      if(variableTypes[variable].has_value() && *variableTypes[variable] != input[t][c].index()) {
+        return output; // values of different types never match
+      }
+      variableTypes[variable] = input[t][c].index();
+      auto it = std::find_if(columnsOfVariables.begin(), columnsOfVariables.end(),
+                             [variable](auto const& entry) { return entry.first == variable; });
+      if(it == columnsOfVariables.end()) {
+        columnsOfVariables.push_back({variable, {c}});
+      } else {
+        it->second.push_back(c);
+      }
+    }
+    std::sort(columnsOfVariables.begin(), columnsOfVariables.end());
+    relations.push_back(sortRelation(input[t], columnsOfVariables));
+  }
+  GenericJoin(relations, numVariables, output).run();
+  return output;
+}
+
+class Engine {
+  simplificationLayer::JoinHelper performMultiwayJoin(simplificationLayer::JoinHelper&& helper) {
+    auto const& input = helper.getInputs();
+    auto const& joinAttributeIndices = helper.getJoinAttributeIndices();
+
+    // the join predicates (each one is between a table and the next one), then the predicates
+    // closing cycles: all of them are evaluated as part of the join
+    vector<simplificationLayer::CyclicPredicate> equalities;
+    for(size_t j = 0; j < joinAttributeIndices.size(); j++) {
+      equalities.push_back(
+          {{j, joinAttributeIndices[j].first}, {j + 1, joinAttributeIndices[j].second}});
+    }
+    auto const& cyclicPredicates = helper.getCyclicPredicates();
+    equalities.insert(equalities.end(), cyclicPredicates.begin(), cyclicPredicates.end());
+
+    helper.appendOutputRowIds(worstCaseOptimalJoin(input, equalities));
+    return std::move(helper);
+  }
+
+public:
+  boss::Expression evaluate(Expression&& expr) { // NOLINT
+    try {
+      return visit(boss::utilities::overload(
+                       [this](ComplexExpression&& e) -> Expression {
+                         if(simplificationLayer::JoinHelper::isJoinPlan(e)) {
+                           return performMultiwayJoin(simplificationLayer::JoinHelper(std::move(e)))
+                               .getResult();
+                         } else {
+                           // evaluate the sub-expression but leave the wrapping expression intact
+                           auto [head, unused_, dynamics, spans] = std::move(e).decompose();
+                           std::transform(std::make_move_iterator(dynamics.begin()),
+                                          std::make_move_iterator(dynamics.end()), dynamics.begin(),
+                                          [this](auto&& arg) {
+                                            return evaluate(std::forward<decltype(arg)>(arg));
+                                          });
+                           return boss::ComplexExpression(std::move(head), {}, std::move(dynamics),
+                                                          std::move(spans));
+                         }
+                       },
+                       [](auto&& v) -> Expression { return std::move(v); }),
+                   std::move(expr));
+    } catch(std::exception const& e) {
+      ExpressionArguments args;
+      args.emplace_back(std::move(expr));
+      args.emplace_back(std::string{e.what()});
+      return ComplexExpression{boss::Symbol("ErrorWhenEvaluatingExpression"), std::move(args)};
+    }
+  }
+};
+
+} // namespace boss::engines::joinonly::worstcaseoptimaljoinonly
+
+using boss::engines::joinonly::worstcaseoptimaljoinonly::Engine;
+
+static auto& enginePtr(bool initialise = true) {
+  static auto engine = std::unique_ptr<Engine>();
+  if(!engine && initialise) {
+    engine.reset(new Engine());
+  }
+  return engine;
+}
+
+extern "C" BOSSExpression* evaluate(BOSSExpression* e) {
+  static std::mutex m;
+  std::lock_guard lock(m);
+  auto* r = new BOSSExpression{enginePtr()->evaluate(std::move(e->delegate))};
+  return r;
+};
+
+extern "C" void reset() { enginePtr(false).reset(nullptr); }
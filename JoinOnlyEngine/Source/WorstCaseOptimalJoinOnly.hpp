@@ -0,0 +1,11 @@
+#pragma once
+
+#include <BOSS.hpp>
+#include <Expression.hpp>
+
+#ifdef _WIN32
+extern "C" {
+__declspec(dllexport) BOSSExpression* evaluate(BOSSExpression* e);
+__declspec(dllexport) void reset();
+}
+#endif // _WIN32
@@ -1,9 +1,14 @@
 #define CATCH_CONFIG_RUNNER
 #include <BOSS.hpp>
 #include <ExpressionUtilities.hpp>
+#include <algorithm>
 #include <array>
 #include <catch2/catch.hpp>
+#include <functional>
 #include <numeric>
+#include <optional>
+#include <sstream>
+#include <thread>
 #include <variant>
 using std::string;
 using std::vector;
@@ -21,6 +26,89 @@ std::vector<string> librariesToTest{}; // NOLINT(cppcoreguidelines-avoid-non-con
 boss::ComplexExpression getEnginesAsList() {
   return {"List"_, {}, boss::ExpressionArguments(librariesToTest.begin(), librariesToTest.end())};
 };
+
+/// whether one of the libraries to test is the given engine (e.g., "HashJoinOnlyEngine")
+bool isTested(string const& engineName) {
+  return std::any_of(librariesToTest.begin(), librariesToTest.end(), [&](auto const& library) {
+    return library.find(engineName) != string::npos;
+  });
+}
+
+/// the libraries to test that are the given engine (e.g., to evaluate in the VolcanoEngine alone)
+boss::ComplexExpression getEngineAsList(string const& engineName) {
+  boss::ExpressionArguments libraries;
+  for(auto const& library : librariesToTest) {
+    if(library.find(engineName) != string::npos) {
+      libraries.emplace_back(library);
+    }
+  }
+  return {"List"_, {}, std::move(libraries)};
+}
+
+/// the rows of a table (as the printed values), sorted: to compare results in any order
+vector<vector<string>> getSortedRows(Expression const& table) {
+  vector<vector<string>> rows;
+  for(auto const& column : get<boss::ComplexExpression>(table).getArguments()) {
+    auto const list = get<boss::ComplexExpression>(column).getArguments().at(0);
+    auto const values = get<boss::ComplexExpression>(list).getArguments();
+    rows.resize(values.size());
+    for(size_t row = 0; row < values.size(); row++) {
+      std::ostringstream value;
+      value << values[row];
+      rows[row].push_back(value.str());
+    }
+  }
+  std::sort(rows.begin(), rows.end());
+  return rows;
+}
+
+/// a table of edges, with the columns <prefix>Begin, <prefix>End and <prefix>Length
+boss::ComplexExpression makeEdgeTable(string const& prefix, vector<int64_t>&& begins,
+                                      vector<int64_t>&& ends, vector<double>&& lengths) {
+  auto column = [&prefix](string const& name, auto&& values) {
+    boss::ExpressionArguments list;
+    list.emplace_back("List"_(boss::Span<typename std::decay_t<decltype(values)>::value_type>(
+        std::forward<decltype(values)>(values))));
+    return boss::ComplexExpression(boss::Symbol(prefix + name), std::move(list));
+  };
+  return "Table"_(column("Begin", std::move(begins)), column("End", std::move(ends)),
+                  column("Length", std::move(lengths)));
+}
+
+/// the edges of the OSM test case (with triangles)
+boss::ComplexExpression makeOSMEdgeTable(string const& prefix) {
+  return makeEdgeTable(prefix, {1, 2, 3, 4, 5, 6, 4, 7, 1}, {2, 3, 1, 5, 4, 5, 6, 3, 7},
+                       {10.0, 7.0, 8.0, 2.0, 15.0, 12.0, 4.0, 20.0, 6.0});
+}
+
+/// edges between numNodes nodes (numRows / numNodes from each one), some of a negative length
+boss::ComplexExpression makeGeneratedEdgeTable(string const& prefix, int64_t numRows,
+                                               int64_t numNodes, int64_t seed) {
+  vector<int64_t> begins(numRows);
+  vector<int64_t> ends(numRows);
+  vector<double> lengths(numRows);
+  for(int64_t row = 0; row < numRows; row++) {
+    begins[row] = row % numNodes;
+    ends[row] = (row * seed + seed) % numNodes;
+    lengths[row] = static_cast<double>((row * seed) % 97) - 10.0;
+  }
+  return makeEdgeTable(prefix, std::move(begins), std::move(ends), std::move(lengths));
+}
+
+/// the paths of three edges (First, Second and Third), with edges of a table made by makeTable
+template <typename MakeTable> boss::ComplexExpression makePaths(MakeTable const& makeTable) {
+  return "Join"_("Join"_(makeTable("First"), makeTable("Second"),
+                         "Where"_("Equal"_("FirstEnd"_, "SecondBegin"_))),
+                 makeTable("Third"), "Where"_("Equal"_("SecondEnd"_, "ThirdBegin"_)));
+}
+
+/// the paths of three edges on generated tables (with a different seed for each table)
+boss::ComplexExpression makeGeneratedPaths(int64_t numRows, int64_t numNodes) {
+  return makePaths([&](string const& prefix) {
+    auto const seed = prefix == "First" ? 3 : prefix == "Second" ? 5 : 7;
+    return makeGeneratedEdgeTable(prefix, numRows, numNodes, seed);
+  });
+}
 } // namespace
 
 // NOLINTBEGIN(readability-magic-numbers)
@@ -90,6 +178,33 @@ TEST_CASE("Basics", "[basics]") { // NOLINT
     }
   }
 
+  SECTION("Relational (mixed types)") {
+    // (the joins of int64_t values with double values are left to the VolcanoEngine, which
+    // compares them numerically, whichever the other columns are)
+    SECTION("Key columns of different types") {
+      auto ints = boss::Span<int64_t>(vector<int64_t>{1, 2, 3});
+      auto doubles = boss::Span<double>(vector<double>{1.0, 2.0});
+      auto result = eval("Join"_("Table"_("A"_("List"_(std::move(ints)))),
+                                 "Table"_("B"_("List"_(std::move(doubles)))),
+                                 "Where"_("Equal"_("A"_, "B"_))));
+      CHECK(result == "Table"_("A"_("List"_(1, 2)), "B"_("List"_(1.0, 2.0))));
+    }
+
+    SECTION("Key columns of different types, with another mixed column") {
+      auto result =
+          eval("Join"_("Table"_("A"_("List"_(1, 2, 3)), "C"_("List"_(1, 2.0, 3))),
+                       "Table"_("B"_("List"_(1.0, 2.0))), "Where"_("Equal"_("A"_, "B"_))));
+      CHECK(result ==
+            "Table"_("A"_("List"_(1, 2)), "C"_("List"_(1, 2.0)), "B"_("List"_(1.0, 2.0))));
+    }
+
+    SECTION("Key column mixing int64_t and double values") {
+      auto result = eval("Join"_("Table"_("A"_("List"_(1, 2.0, 3))),
+                                 "Table"_("B"_("List"_(1, 2, 3))), "Where"_("Equal"_("A"_, "B"_))));
+      CHECK(result == "Table"_("A"_("List"_(1, 2.0, 3)), "B"_("List"_(1, 2, 3))));
+    }
+  }
+
   SECTION("Relational (empty table)") {
     auto emptyCustomerTable =
         "Table"_("ID"_("List"_()), "FirstName"_("List"_()), "LastName"_("List"_()),
@@ -162,6 +277,27 @@ TEST_CASE("SimpleMultiWayJoin", "[join]") { // NOLINT
   }
 }
 
+TEST_CASE("Each engine in turn", "[join]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  // (the libraries are loaded in the same process: each one must still run its own algorithms)
+  auto const query = makePaths(makeOSMEdgeTable);
+  std::optional<vector<vector<string>>> expected;
+  for(auto const& library : librariesToTest) {
+    INFO(library);
+    boss::ExpressionArguments libraries;
+    libraries.emplace_back(library);
+    auto rows = getSortedRows(
+        boss::evaluate("EvaluateInEngines"_(boss::ComplexExpression("List"_, std::move(libraries)),
+                                            query.clone(CloneReason::FOR_TESTING))));
+    if(!expected) {
+      expected = std::move(rows);
+      REQUIRE(!expected->empty());
+      continue;
+    }
+    CHECK(rows == *expected);
+  }
+}
+
 TEST_CASE("OSM", "[OSM]") { // NOLINT
   REQUIRE(!librariesToTest.empty());
   auto eval = [](boss::Expression&& expression) mutable {
@@ -338,6 +474,503 @@ TEST_CASE("OSM", "[OSM]") { // NOLINT
   }
 }
 
+TEST_CASE("Cycles", "[join][cycles]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEnginesAsList(), std::move(expression)));
+  };
+
+  // the OSM edges (each table of the cycle is a copy of them)
+  vector<int64_t> const begins = {1, 2, 3, 4, 5, 6, 4, 7, 1};
+  vector<int64_t> const ends = {2, 3, 1, 5, 4, 5, 6, 3, 7};
+  vector<double> const lengths = {10.0, 7.0, 8.0, 2.0, 15.0, 12.0, 4.0, 20.0, 6.0};
+  auto symbol = [](size_t edge, string const& name) {
+    return boss::Symbol("Edge" + std::to_string(edge) + name);
+  };
+
+  auto k = GENERATE(3, 4);
+  // the cycles of k edges: a chain of joins, closed by a selection
+  boss::Expression cycles = makeEdgeTable("Edge0", vector(begins), vector(ends), vector(lengths));
+  for(int edge = 1; edge < k; edge++) {
+    cycles = "Join"_(std::move(cycles),
+                     makeEdgeTable("Edge" + std::to_string(edge), vector(begins), vector(ends),
+                                   vector(lengths)),
+                     "Where"_("Equal"_(symbol(edge - 1, "End"), symbol(edge, "Begin"))));
+  }
+  cycles =
+      "Select"_(std::move(cycles), "Where"_("Equal"_(symbol(k - 1, "End"), symbol(0, "Begin"))));
+
+  // the same cycles, enumerated edge by edge
+  vector<vector<string>> expected;
+  vector<size_t> path;
+  auto print = [](boss::Expression&& value) {
+    std::ostringstream printed;
+    printed << value;
+    return printed.str();
+  };
+  std::function<void()> extendPath = [&]() {
+    if(path.size() == static_cast<size_t>(k)) {
+      if(ends[path.back()] == begins[path.front()]) {
+        auto& row = expected.emplace_back();
+        for(auto edge : path) {
+          row.push_back(print(begins[edge]));
+          row.push_back(print(ends[edge]));
+          row.push_back(print(lengths[edge]));
+        }
+      }
+      return;
+    }
+    for(size_t edge = 0; edge < begins.size(); edge++) {
+      if(path.empty() || ends[path.back()] == begins[edge]) {
+        path.push_back(edge);
+        extendPath();
+        path.pop_back();
+      }
+    }
+  };
+  extendPath();
+  std::sort(expected.begin(), expected.end());
+  REQUIRE(!expected.empty());
+
+  auto output = eval(std::move(cycles));
+  INFO(output);
+  CHECK(getSortedRows(output) == expected);
+}
+
+TEST_CASE("HashJoinOnly options", "[join][options]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  if(!isTested("HashJoinOnlyEngine")) {
+    return; // (the options are the HashJoinOnlyEngine's)
+  }
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEnginesAsList(), std::move(expression)));
+  };
+
+  // the paths of three edges (on the OSM tables, and on generated tables of 6000 rows each)
+  vector<boss::Expression> queries;
+  queries.emplace_back(makePaths(makeOSMEdgeTable));
+  queries.emplace_back("Select"_(makePaths(makeOSMEdgeTable),
+                                 "Where"_("Equal"_("ThirdEnd"_, "FirstBegin"_))));
+  queries.emplace_back(makeGeneratedPaths(6000, 3000));
+
+  // the results with the default options
+  vector<vector<vector<string>>> expected;
+  for(auto const& query : queries) {
+    expected.push_back(getSortedRows(eval(query.clone(CloneReason::FOR_TESTING))));
+    REQUIRE(!expected.back().empty());
+  }
+
+  // runs the queries with an option set, then sets it back to its default value
+  auto checkWithOption = [&](boss::Symbol const& option, int64_t value, int64_t defaultValue) {
+    CHECK(eval("Set"_(option, value)) == true);
+    for(size_t q = 0; q < queries.size(); q++) {
+      INFO(q);
+      CHECK(getSortedRows(eval(queries[q].clone(CloneReason::FOR_TESTING))) == expected[q]);
+    }
+    eval("Set"_(option, defaultValue));
+  };
+
+  SECTION("Radix partitioning") {
+    checkWithOption("RadixPartitioningMinRows"_, 1, int64_t(1) << 16);
+    checkWithOption("RadixPartitioningPasses"_, 0, 1);
+  }
+
+  SECTION("Semi-join reduction") { checkWithOption("SemiJoinReduction"_, 1, 0); }
+
+  SECTION("Without Bloom filters") { checkWithOption("BloomFilters"_, 0, 1); }
+
+  SECTION("Without join ordering") {
+    // (by default, the order is chosen from the statistics: the distinct values of the generated
+    // tables, of more than 4096 rows, are estimated from a sample)
+    checkWithOption("JoinOrdering"_, 0, 1);
+  }
+
+  SECTION("Without factorized results") { checkWithOption("FactorizedResults"_, 0, 1); }
+
+  SECTION("Morsels and threads") {
+    // (with morsels of 7 rows, each probe is split over many morsels, stolen by the workers)
+    auto const defaultThreads = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+    checkWithOption("MorselSize"_, 7, 16384);
+    checkWithOption("Threads"_, 1, defaultThreads);
+    CHECK(eval("Set"_("MorselSize"_, 7)) == true);
+    checkWithOption("Threads"_, 4, defaultThreads);
+    checkWithOption("FactorizedResults"_, 0, 1);
+    eval("Set"_("MorselSize"_, 16384));
+  }
+
+  SECTION("Memory budget") {
+    // (the hash tables go over both budgets: the joins spill to disk, into 128 or fewer partitions)
+    checkWithOption("MemoryBudget"_, 1, 0);
+    checkWithOption("MemoryBudget"_, int64_t(1) << 16, 0);
+  }
+}
+
+TEST_CASE("HashJoinOnly score pruning", "[join][options]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  if(!isTested("HashJoinOnlyEngine")) {
+    return; // (the option is the HashJoinOnlyEngine's)
+  }
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEnginesAsList(), std::move(expression)));
+  };
+  // runs a query with the pruning on scores on (the default) or off
+  auto run = [&](boss::ComplexExpression const& query, int64_t scorePruning) {
+    CHECK(eval("Set"_("ScorePruning"_, scorePruning)) == true);
+    auto rows = getSortedRows(eval(query.clone(CloneReason::FOR_TESTING)));
+    eval("Set"_("ScorePruning"_, 1));
+    return rows;
+  };
+  auto totalLength = [] { return "Plus"_("FirstLength"_, "SecondLength"_, "ThirdLength"_); };
+  // the total lengths of the rows of paths (with the lengths as columns 2, 5 and 8), sorted
+  auto getTotalLengths = [](vector<vector<string>> const& rows) {
+    vector<double> totals;
+    for(auto const& row : rows) {
+      totals.push_back(std::stod(row[2]) + std::stod(row[5]) + std::stod(row[8]));
+    }
+    std::sort(totals.begin(), totals.end());
+    return totals;
+  };
+
+  // (the lengths of the edges are between -10 and 86: many paths have the same total length)
+  auto const threshold = GENERATE(-20.0, 150.0);
+  auto const selection = "Select"_(makeGeneratedPaths(6000, 3000),
+                                   "Where"_("Greater"_(totalLength(), threshold)));
+  auto const selected = run(selection, 0);
+  REQUIRE(!selected.empty());
+
+  SECTION("Selection on the total length") { CHECK(run(selection, 1) == selected); }
+
+  SECTION("Top of the selection") {
+    auto const n = GENERATE(1, 10, 100);
+    auto const top = "Top"_(selection.clone(CloneReason::FOR_TESTING), n, totalLength());
+    auto const pruned = run(top, 1);
+    auto const notPruned = run(top, 0);
+    CHECK(pruned.size() == std::min(static_cast<size_t>(n), selected.size()));
+    CHECK(getTotalLengths(pruned) == getTotalLengths(notPruned));
+    // (among the paths tied with the n-th one, any can be in the top ones)
+    for(auto const& row : pruned) {
+      CHECK(std::binary_search(selected.begin(), selected.end(), row));
+    }
+  }
+}
+
+TEST_CASE("NestedLoopJoinOnly options", "[join][options]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  if(!isTested("NestedLoopJoinOnlyEngine")) {
+    return; // (the options are the NestedLoopJoinOnlyEngine's)
+  }
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEnginesAsList(), std::move(expression)));
+  };
+
+  // the paths and the cycles of three edges (on the OSM tables and on generated tables)
+  vector<boss::Expression> queries;
+  queries.emplace_back(makePaths(makeOSMEdgeTable));
+  queries.emplace_back("Select"_(makePaths(makeOSMEdgeTable),
+                                 "Where"_("Equal"_("ThirdEnd"_, "FirstBegin"_))));
+  queries.emplace_back(makeGeneratedPaths(6000, 3000));
+  queries.emplace_back("Select"_(makeGeneratedPaths(6000, 3001),
+                                 "Where"_("Equal"_("ThirdEnd"_, "FirstBegin"_))));
+
+  SECTION("Block nested loop") {
+    // (the tiled join gives the same rows as the scalar one, for the chains and the cycles)
+    vector<vector<vector<string>>> expected;
+    for(auto const& query : queries) {
+      expected.push_back(getSortedRows(eval(query.clone(CloneReason::FOR_TESTING))));
+      REQUIRE(!expected.back().empty());
+    }
+    CHECK(eval("Set"_("BlockNestedLoop"_, 0)) == true);
+    for(size_t q = 0; q < queries.size(); q++) {
+      INFO(q);
+      CHECK(getSortedRows(eval(queries[q].clone(CloneReason::FOR_TESTING))) == expected[q]);
+    }
+    eval("Set"_("BlockNestedLoop"_, 1));
+  }
+}
+
+TEST_CASE("Competition options", "[join][options]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  if(!isTested("CompetitionEngine")) {
+    return; // (the options are the CompetitionEngine's)
+  }
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEnginesAsList(), std::move(expression)));
+  };
+
+  // the paths and the cycles of three edges (on the OSM tables and on generated tables: with a
+  // prime number of nodes, a few generated paths close a cycle), and generated edges followed by
+  // the OSM edges (the hash table on the few OSM keys is the smaller one)
+  vector<boss::Expression> queries;
+  queries.emplace_back(makePaths(makeOSMEdgeTable));
+  queries.emplace_back("Select"_(makePaths(makeOSMEdgeTable),
+                                 "Where"_("Equal"_("ThirdEnd"_, "FirstBegin"_))));
+  queries.emplace_back(makeGeneratedPaths(6000, 3000));
+  queries.emplace_back("Select"_(makeGeneratedPaths(6000, 3001),
+                                 "Where"_("Equal"_("ThirdEnd"_, "FirstBegin"_))));
+  queries.emplace_back("Join"_(makeGeneratedEdgeTable("First", 6000, 8, 5),
+                               makeOSMEdgeTable("Second"),
+                               "Where"_("Equal"_("FirstEnd"_, "SecondBegin"_))));
+
+  // the results with the default options
+  vector<vector<vector<string>>> expected;
+  for(auto const& query : queries) {
+    expected.push_back(getSortedRows(eval(query.clone(CloneReason::FOR_TESTING))));
+    REQUIRE(!expected.back().empty());
+  }
+
+  // runs the queries with an option set, then sets it back to its default value
+  auto checkWithOption = [&](boss::Symbol const& option, int64_t value, int64_t defaultValue) {
+    CHECK(eval("Set"_(option, value)) == true);
+    for(size_t q = 0; q < queries.size(); q++) {
+      INFO(q);
+      CHECK(getSortedRows(eval(queries[q].clone(CloneReason::FOR_TESTING))) == expected[q]);
+    }
+    eval("Set"_(option, defaultValue));
+  };
+
+  SECTION("Each join algorithm") {
+    // (NestedLoop, Hash, RadixPartitionedHash and SortMerge for every step)
+    auto algorithm = GENERATE(1, 2, 3, 4);
+    checkWithOption("JoinAlgorithm"_, algorithm, 0);
+  }
+
+  SECTION("Adaptive choice") {
+    // (without nested-loop joins, the OSM steps are hash joins too, radix-partitioned with the
+    // minimum of a single row)
+    checkWithOption("NestedLoopMaxPairs"_, 0, 4096);
+    checkWithOption("RadixPartitioningMinRows"_, 1, int64_t(1) << 16);
+    CHECK(eval("Set"_("NestedLoopMaxPairs"_, 0)) == true);
+    checkWithOption("RadixPartitioningMinRows"_, 1, int64_t(1) << 16);
+    eval("Set"_("NestedLoopMaxPairs"_, 4096));
+    // (the OSM edges, last, probe into the generated edges: the hash table is built on the probe
+    // keys instead, then the matches are swapped back)
+    checkWithOption("JoinOrdering"_, 0, 1);
+    CHECK(eval("Set"_("JoinOrdering"_, 0)) == true);
+    checkWithOption("RadixPartitioningMinRows"_, 1, int64_t(1) << 16);
+    eval("Set"_("JoinOrdering"_, 1));
+  }
+
+  SECTION("Memory budget") {
+    // (every hash table goes over the budget: the steps are sort-merge joins instead)
+    checkWithOption("MemoryBudget"_, 1, 0);
+  }
+
+  SECTION("Threads") {
+    // (the partitions of the radix-partitioned hash joins are joined by 4 workers)
+    auto const defaultThreads = std::max<int64_t>(std::thread::hardware_concurrency(), 1);
+    CHECK(eval("Set"_("JoinAlgorithm"_, 3)) == true);
+    checkWithOption("Threads"_, 4, defaultThreads);
+    eval("Set"_("JoinAlgorithm"_, 0));
+  }
+}
+
+TEST_CASE("VolcanoEngine joins", "[volcano]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  if(!isTested("VolcanoEngine")) {
+    return;
+  }
+  // (in the VolcanoEngine alone: the joins are not simplified by another engine first)
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEngineAsList("VolcanoEngine"),
+                                               std::move(expression)));
+  };
+  auto left = [] {
+    return "Table"_("L1"_("List"_(1, 2, 3, 4, 2)), "L2"_("List"_(10, 20, 30, 40, 25)));
+  };
+  auto right = [] { return "Table"_("R1"_("List"_(2, 3, 5, 2)), "R2"_("List"_(20, 31, 50, 21))); };
+
+  SECTION("Empty right side") {
+    auto result = eval("Join"_(left(), "Table"_("R1"_("List"_()), "R2"_("List"_())),
+                               "Where"_("Equal"_("L1"_, "R1"_))));
+    CHECK(result == "Table"_("L1"_("List"_()), "L2"_("List"_()), "R1"_("List"_()),
+                             "R2"_("List"_())));
+  }
+
+  SECTION("Two equi-join keys") {
+    auto result = eval("Join"_(left(), right(),
+                               "Where"_("And"_("Equal"_("L1"_, "R1"_), "Equal"_("R2"_, "L2"_)))));
+    CHECK(result ==
+          "Table"_("L1"_("List"_(2)), "L2"_("List"_(20)), "R1"_("List"_(2)), "R2"_("List"_(20))));
+  }
+
+  SECTION("Equi-join key and residual condition") {
+    auto result = eval("Join"_(left(), right(),
+                               "Where"_("And"_("Equal"_("L1"_, "R1"_), "Greater"_("L2"_, "R2"_)))));
+    CHECK(result == "Table"_("L1"_("List"_(2, 2)), "L2"_("List"_(25, 25)), "R1"_("List"_(2, 2)),
+                             "R2"_("List"_(20, 21))));
+  }
+
+  SECTION("Without equi-join key") {
+    auto result = eval("Join"_(left(), right(), "Where"_("Greater"_("L1"_, "R1"_))));
+    CHECK(result == "Table"_("L1"_("List"_(3, 3, 4, 4, 4)), "L2"_("List"_(30, 30, 40, 40, 40)),
+                             "R1"_("List"_(2, 2, 2, 3, 2)), "R2"_("List"_(20, 21, 20, 31, 21))));
+  }
+
+  SECTION("More matches than a batch") {
+    // (every row matches every row: the matches of each left-side row span several batches)
+    auto const numRows = 3000;
+    auto result = eval("Join"_(makeGeneratedEdgeTable("First", 3, 1, 3),
+                               makeGeneratedEdgeTable("Second", numRows, 1, 5),
+                               "Where"_("Equal"_("FirstBegin"_, "SecondBegin"_))));
+    CHECK(getSortedRows(result).size() == 3 * numRows);
+  }
+}
+
+TEST_CASE("VolcanoEngine arithmetic", "[volcano]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  if(!isTested("VolcanoEngine")) {
+    return;
+  }
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEngineAsList("VolcanoEngine"),
+                                               std::move(expression)));
+  };
+  // int64_t columns (A, B and C), a double_t one (D) and a mixed one (M)
+  auto table = [] {
+    return "Table"_("A"_("List"_(1, 2, 3)), "B"_("List"_(10, 20, 30)), "C"_("List"_(2, 3, 4)),
+                    "D"_("List"_(0.5, 1.5, 2.5)), "M"_("List"_(1, 2.5, 3)));
+  };
+
+  SECTION("Project with nested arithmetic") {
+    // (the sum with a constant is not a fused kernel: it is computed by the bytecode)
+    auto result = eval("Project"_(table(), "As"_("X"_, "Multiply"_("Plus"_("A"_, "B"_, 1), "C"_)),
+                                  "As"_("Y"_, "Plus"_("Multiply"_("A"_, "C"_), "B"_))));
+    CHECK(result == "Table"_("X"_("List"_(24, 69, 136)), "Y"_("List"_(12, 26, 42))));
+  }
+
+  SECTION("int64_t with double_t") {
+    auto result = eval("Project"_(table(), "As"_("X"_, "Plus"_("A"_, "D"_)),
+                                  "As"_("Y"_, "Multiply"_("A"_, 2.5)),
+                                  "As"_("Z"_, "Plus"_("Multiply"_("D"_, 2), "B"_))));
+    CHECK(result == "Table"_("X"_("List"_(1.5, 3.5, 5.5)), "Y"_("List"_(2.5, 5.0, 7.5)),
+                             "Z"_("List"_(11.0, 23.0, 35.0))));
+    auto selected = eval("Select"_(table(), "Where"_("Greater"_("Plus"_("A"_, "D"_), 3))));
+    CHECK(getSortedRows(selected) == vector<vector<string>>{{"2", "20", "3", "1.5", "2.5"},
+                                                            {"3", "30", "4", "2.5", "3"}});
+  }
+
+  SECTION("Mixed column") {
+    auto result = eval("Project"_(table(), "As"_("X"_, "Plus"_("M"_, "A"_)),
+                                  "As"_("Y"_, "Multiply"_("M"_, "D"_))));
+    CHECK(result == "Table"_("X"_("List"_(2, 4.5, 6)), "Y"_("List"_(0.5, 3.75, 7.5))));
+    auto selected = eval("Select"_(table(), "Where"_("Greater"_("Plus"_("M"_, "A"_), 4))));
+    CHECK(getSortedRows(selected) == vector<vector<string>>{{"2", "20", "3", "1.5", "2.5"},
+                                                            {"3", "30", "4", "2.5", "3"}});
+  }
+
+  SECTION("Mixed column in a nested loop join") {
+    // (the candidate pairs span several left-side rows: the mixed values gathered into a batch
+    // keep their own types)
+    auto join = [&] {
+      return "Join"_(table(), "Table"_("R"_("List"_(0, 1))),
+                     "Where"_("Greater"_("Plus"_("M"_, "R"_), 2)));
+    };
+    auto result = eval("Project"_(join(), "As"_("M"_, "M"_), "As"_("R"_, "R"_),
+                                  "As"_("X"_, "Plus"_("M"_, "R"_))));
+    CHECK(result == "Table"_("M"_("List"_(2.5, 2.5, 3, 3)), "R"_("List"_(0, 1, 0, 1)),
+                             "X"_("List"_(2.5, 3.5, 3, 4))));
+  }
+}
+
+TEST_CASE("VolcanoEngine fused kernels", "[volcano]") { // NOLINT
+  REQUIRE(!librariesToTest.empty());
+  if(!isTested("VolcanoEngine")) {
+    return;
+  }
+  auto eval = [](boss::Expression&& expression) mutable {
+    return boss::evaluate("EvaluateInEngines"_(getEngineAsList("VolcanoEngine"),
+                                               std::move(expression)));
+  };
+  // nine int64_t columns (I1 to I9), nine double_t ones (D1 to D9) and a mixed one (M), with
+  // values between -50 and 50 (the doubles, multiples of 0.5, are summed exactly in any order)
+  auto const numRows = 3000;
+  auto const numColumns = 9;
+  auto table = [&] {
+    auto value = [](int64_t row, int64_t column) { return (row * (column + 3) * 7919) % 101 - 50; };
+    boss::ExpressionArguments columns;
+    auto addColumn = [&columns](string const& name, boss::Expression&& values) {
+      boss::ExpressionArguments list;
+      list.emplace_back(std::move(values));
+      columns.emplace_back(boss::ComplexExpression(boss::Symbol(name), std::move(list)));
+    };
+    for(int64_t column = 1; column <= numColumns; column++) {
+      vector<int64_t> ints(numRows);
+      vector<double> doubles(numRows);
+      for(int64_t row = 0; row < numRows; row++) {
+        ints[row] = value(row, column);
+        doubles[row] = static_cast<double>(value(row, numColumns + column)) / 2;
+      }
+      addColumn("I" + std::to_string(column), "List"_(boss::Span<int64_t>(std::move(ints))));
+      addColumn("D" + std::to_string(column), "List"_(boss::Span<double>(std::move(doubles))));
+    }
+    boss::ExpressionArguments mixed;
+    for(int64_t row = 0; row < numRows; row++) {
+      if(row % 2 == 0) {
+        mixed.emplace_back(value(row, 0));
+      } else {
+        mixed.emplace_back(static_cast<double>(value(row, 0)) / 2);
+      }
+    }
+    addColumn("M", boss::ComplexExpression("List"_, std::move(mixed)));
+    return boss::ComplexExpression("Table"_, std::move(columns));
+  };
+  auto terms = [](vector<string> const& names) {
+    boss::ExpressionArguments args;
+    for(auto const& name : names) {
+      args.emplace_back(boss::Symbol(name));
+    }
+    return args;
+  };
+  auto selectGreater = [&](boss::ExpressionArguments&& args, boss::Expression&& constant) {
+    auto sum = boss::ComplexExpression("Plus"_, std::move(args));
+    return eval("Select"_(table(), "Where"_("Greater"_(std::move(sum), std::move(constant)))));
+  };
+  auto projectSum = [&](boss::ExpressionArguments&& args) {
+    auto sum = boss::ComplexExpression("Plus"_, std::move(args));
+    return eval("Project"_(table(), "As"_("Sum"_, std::move(sum))));
+  };
+
+  // a sum with a constant term is not a fused kernel: it is computed by the generic bytecode
+  auto checkAgainstBytecode = [&](vector<string> const& names) {
+    INFO(names.size() << " terms, from " << names[0]);
+    for(auto doubleConstant : {false, true}) {
+      INFO((doubleConstant ? "double_t" : "int64_t") << " constant");
+      auto constant = [&]() -> boss::Expression {
+        return doubleConstant ? boss::Expression(0.5) : boss::Expression(int64_t(0));
+      };
+      auto withConstantTerm = terms(names);
+      withConstantTerm.emplace_back(int64_t(0));
+      auto const selected = selectGreater(terms(names), constant());
+      CHECK(selected == selectGreater(std::move(withConstantTerm), constant()));
+      auto const numSelected = getSortedRows(selected).size();
+      CHECK(numSelected > 0);
+      CHECK(numSelected < numRows);
+    }
+    auto withConstantTerm = terms(names);
+    withConstantTerm.emplace_back(int64_t(0));
+    CHECK(projectSum(terms(names)) == projectSum(std::move(withConstantTerm)));
+  };
+
+  SECTION("Columns of a single type") {
+    // (with 9 terms, more than the largest kernel takes, the sum falls back to the bytecode)
+    auto const arity = GENERATE(1, 8, 9);
+    auto const prefix = GENERATE("I"s, "D"s);
+    vector<string> names;
+    for(int64_t column = 1; column <= arity; column++) {
+      names.push_back(prefix + std::to_string(column));
+    }
+    checkAgainstBytecode(names);
+  }
+
+  SECTION("Columns of different types") {
+    // (no kernel: the sums fall back to the bytecode)
+    checkAgainstBytecode({"I1", "D1"});
+    checkAgainstBytecode({"D1", "I1", "I2"});
+    checkAgainstBytecode({"M"});
+    checkAgainstBytecode({"M", "I1", "D1"});
+  }
+}
+
 int main(int argc, char* argv[]) {
   Catch::Session session;
   session.cli(session.cli() | Catch::clara::Opt(librariesToTest, "library")["--library"]);
@@ -1,9 +1,13 @@
 #pragma once
 
 #include "RelationalOps/Operator.hpp"
+#include "Batch.hpp"
+#include "Bytecode.hpp"
 #include "Types.hpp"
 #include <Expression.hpp>
 #include <ExpressionUtilities.hpp>
+#include <functional>
+#include <optional>
 #include <tuple>
 #include <vector>
 
@@ -14,130 +18,324 @@ namespace boss::engines::volcano {
 
 using operators::Operator;
 
-std::tuple<Schema, std::vector<Tuple>> toSchemaAndData(ComplexExpression&& e) {
-  auto columns = std::move(e).getDynamicArguments();
-  if(columns.empty()) {
-    return {};
-  }
-  auto numTuples =
-      boss::get<ComplexExpression>(boss::get<ComplexExpression>(columns[0]).getArguments()[0])
-          .getArguments()
-          .size();
-  std::vector<Tuple> tuples(numTuples);
+/**
+ * Converts a table expression into its schema and its rows, as a single batch (with a typed
+ * column for each attribute).
+ */
+std::tuple<Schema, Batch> toSchemaAndColumns(ComplexExpression&& e) {
   Schema schema;
-  for(auto&& column : columns) {
+  Batch batch;
+  for(auto&& column : std::move(e).getDynamicArguments()) {
     auto [head, unused_, dynamics, unused2_] =
         boss::get<ComplexExpression>(std::move(column)).decompose();
     schema.emplace_back(std::move(head).getName());
     auto list = *std::make_move_iterator(dynamics.begin());
-    auto tupleIt = tuples.begin();
+    auto& values = batch.columns.emplace_back(std::vector<int64_t>());
     for(auto&& valExpr : boss::get<ComplexExpression>(list).getArguments()) {
       boss::expressions::generic::visit(
-          [&tupleIt](auto&& val) {
+          [&values](auto&& val) {
             if constexpr(std::is_same_v<std::decay_t<decltype(val)>, int64_t> ||
                          std::is_same_v<std::decay_t<decltype(val)>, double_t>) {
-              tupleIt->emplace_back(std::move(val));
+              appendValue(values, val);
             } else {
               throw std::runtime_error("unsupported type as a tuple value");
             }
           },
           std::move(valExpr));
-      ++tupleIt;
     }
   }
-  return {std::move(schema), std::move(tuples)};
+  return {std::move(schema), std::move(batch)};
+}
+
+/// the index of a column in a schema
+size_t getColumnIndex(Schema const& schema, Symbol const& symbol) {
+  auto it = std::find(schema.begin(), schema.end(), symbol.getName());
+  if(it == schema.end()) {
+    throw std::runtime_error("Unknown column: " + symbol.getName());
+  }
+  return std::distance(schema.begin(), it);
+}
+
+/// a compiled operand: the slot holding its values, and their type
+struct Operand {
+  Slot slot;
+  ColumnType type;
+};
+
+/// converts an operand to a type (at least as general as its own)
+Operand convertOperand(Operand operand, ColumnType type, Program& program) {
+  if(operand.type == type) {
+    return operand;
+  }
+  auto const target = program.addRegister();
+  program.emit(type == ColumnType::Double ? OpCode::ToDouble : OpCode::ToMixed, target,
+               operand.slot);
+  return {target, type};
+}
+
+/// the type that the values of both operands convert to (e.g., a double, for an int64 and a double)
+ColumnType getCommonType(Operand const& lhs, Operand const& rhs) {
+  return std::max(lhs.type, rhs.type); // (from the most specific to the most general)
+}
+
+/**
+ * The columns of the operands of an operation, if they all are (symbols of) columns of the same
+ * type: as the fused kernels take them.
+ */
+std::optional<std::tuple<std::vector<Slot>, ColumnType>>
+getSameTypeColumns(ExpressionArguments const& args, Operator const& input) {
+  std::vector<Slot> columns;
+  std::optional<ColumnType> type;
+  for(auto const& arg : args) {
+    if(!std::holds_alternative<Symbol>(arg)) {
+      return {};
+    }
+    auto const column = getColumnIndex(input.getSchema(), std::get<Symbol>(arg));
+    auto const columnType = input.getColumnTypes()[column];
+    if(type && *type != columnType) {
+      return {};
+    }
+    type = columnType;
+    columns.push_back(static_cast<Slot>(column));
+  }
+  if(!type) {
+    return {};
+  }
+  return {{std::move(columns), *type}};
 }
 
-ArithmeticOp toArithmeticOp(Expression&& e, Operator const& input);
+Operand compileArithmetic(Expression&& e, Program& program, Operator const& input);
 
-ArithmeticOp toArithmeticOp(ComplexExpression&& e, Operator const& input) {
+Operand compileArithmetic(ComplexExpression&& e, Program& program, Operator const& input) {
+  auto fold = [&program, &input](ExpressionArguments&& args, OpCode int64Variant) {
+    auto it = std::make_move_iterator(args.begin());
+    auto acc = compileArithmetic(std::move(*it++), program, input);
+    for(; it != std::make_move_iterator(args.end()); ++it) {
+      auto arg = compileArithmetic(std::move(*it), program, input);
+      auto const type = getCommonType(acc, arg);
+      auto lhs = convertOperand(acc, type, program);
+      auto rhs = convertOperand(arg, type, program);
+      // (the partial results are accumulated in the same register)
+      auto const target = program.isTemporary(lhs.slot) ? lhs.slot : program.addRegister();
+      program.emit(typedOpCode(int64Variant, type), target, lhs.slot, rhs.slot);
+      acc = {target, type};
+    }
+    return acc;
+  };
   if(e.getHead() == "Plus"_) {
-    auto args = std::move(e).getArguments();
-    return std::accumulate(
-        std::make_move_iterator(args.begin() + 1), std::make_move_iterator(args.end()),
-        toArithmeticOp(*args.begin(), input), [&input](auto&& acc, auto&& expr) -> ArithmeticOp {
-          return [leftArg = std::move(acc), rightArg = toArithmeticOp(std::move(expr), input)](
-                     Tuple const& tuple) { return leftArg(tuple) + rightArg(tuple); };
-        });
+    // Plus(c1, ..., cn): a fused kernel, if there is one for the columns
+    if(auto columns = getSameTypeColumns(e.getDynamicArguments(), input)) {
+      auto& [slots, type] = *columns;
+      if(auto* kernel = findSumKernel(type, slots.size())) {
+        auto const target = program.addRegister();
+        program.emitKernelCall(kernel, target, std::move(slots));
+        return {target, type};
+      }
+    }
+    return fold(std::move(e).getArguments(), OpCode::PlusInt64);
   }
   if(e.getHead() == "Multiply"_) {
-    auto args = std::move(e).getArguments();
-    return std::accumulate(
-        std::make_move_iterator(args.begin() + 1), std::make_move_iterator(args.end()),
-        toArithmeticOp(*args.begin(), input), [&input](auto&& acc, auto&& expr) -> ArithmeticOp {
-          return [leftArg = std::move(acc), rightArg = toArithmeticOp(std::move(expr), input)](
-                     Tuple const& tuple) { return leftArg(tuple) * rightArg(tuple); };
-        });
+    return fold(std::move(e).getArguments(), OpCode::MultiplyInt64);
   }
   throw std::runtime_error("Unknown arithmetic operator: " + e.getHead().getName());
 }
 
-ArithmeticOp toArithmeticOp(Expression&& e, Operator const& input) {
+Operand compileArithmetic(Expression&& e, Program& program, Operator const& input) {
   if(std::holds_alternative<int64_t>(e)) {
-    return [val = boss::get<int64_t>(e)](Tuple const& /*tuple*/) { return val; };
-  } else if(std::holds_alternative<double_t>(e)) {
-    return [val = boss::get<double_t>(e)](Tuple const& /*tuple*/) { return val; };
-  } else if(std::holds_alternative<Symbol>(e)) {
-    return [colIndex = std::distance(input.getSchema().begin(),
-                                     std::find(input.getSchema().begin(), input.getSchema().end(),
-                                               boss::get<Symbol>(e).getName()))](
-               Tuple const& tuple) { return tuple[colIndex]; };
-  } else {
-    return toArithmeticOp(boss::get<ComplexExpression>(std::move(e)), input);
+    return {program.addConstant(boss::get<int64_t>(e)), ColumnType::Int64};
   }
+  if(std::holds_alternative<double_t>(e)) {
+    return {program.addConstant(boss::get<double_t>(e)), ColumnType::Double};
+  }
+  if(std::holds_alternative<Symbol>(e)) {
+    auto const column = getColumnIndex(input.getSchema(), boss::get<Symbol>(e));
+    auto const type = input.getColumnTypes()[column];
+    if(type == ColumnType::Mixed) {
+      // (the values of a mixed column are only known to be variants once converted)
+      auto const target = program.addRegister();
+      program.emit(OpCode::ToMixed, target, static_cast<Slot>(column));
+      return {target, type};
+    }
+    return {static_cast<Slot>(column), type};
+  }
+  return compileArithmetic(boss::get<ComplexExpression>(std::move(e)), program, input);
 }
 
-std::tuple<Schema, Projection>
-toSchemaAndProjection(std::move_iterator<ExpressionArguments::iterator> asExprIt,
+/**
+ * Compiles an arithmetic expression (on the attributes of the input) into a program that computes
+ * its values for all the rows of a batch.
+ */
+Program toArithmeticProgram(Expression&& e, Operator const& input) {
+  Program program(input.getSchema().size());
+  auto result = compileArithmetic(std::move(e), program, input);
+  program.setResult(result.slot, result.type);
+  return program;
+}
+
+std::tuple<Schema, std::vector<Program>>
+toSchemaAndProjectors(std::move_iterator<ExpressionArguments::iterator> asExprIt,
                       std::move_iterator<ExpressionArguments::iterator> asExprItEnd,
                       Operator const& input) {
-  std::vector<ArithmeticOp> projectors;
+  std::vector<Program> projectors;
   Schema schema;
-  auto const& oldSchema = input.getSchema();
   for(; asExprIt != asExprItEnd; ++asExprIt) {
     auto asExpr = boss::get<ComplexExpression>(std::move(*asExprIt));
     auto [unused0_, unused1_, dynamics, unused2_] = std::move(asExpr).decompose();
     auto it = std::make_move_iterator(dynamics.begin());
     schema.emplace_back(boss::get<Symbol>(*it++).getName());
-    projectors.emplace_back(toArithmeticOp(std::move(*it++), input));
-  }
-  // so far handles only column name mapping (no arithmetic expressions)
-  return {std::move(schema), [projs = std::move(projectors)](Tuple const& tuple) {
-            Tuple projected;
-            std::transform(projs.begin(), projs.end(), std::back_inserter(projected),
-                           [&tuple](auto& proj) { return proj(tuple); });
-            return projected;
-          }};
+    projectors.emplace_back(toArithmeticProgram(std::move(*it++), input));
+  }
+  return {std::move(schema), std::move(projectors)};
 }
 
-Predicate toPredicate(ComplexExpression&& e, Operator const& input) {
+/**
+ * Compiles a comparison into a call to a fused kernel, if there is one for its shape:
+ * Greater(Plus(c1, ..., cn), constant) or Equal(colA, colB), with columns of the same type.
+ *
+ * @return Whether it was (otherwise, nothing was compiled).
+ */
+bool compilePredicateKernelCall(Symbol const& head, ExpressionArguments const& args,
+                                    Program& program, Operator const& input) {
+  if(args.size() != 2) {
+    return false;
+  }
+  if(head == "Greater"_ && std::holds_alternative<ComplexExpression>(args[0]) &&
+     std::get<ComplexExpression>(args[0]).getHead() == "Plus"_ &&
+     (std::holds_alternative<int64_t>(args[1]) || std::holds_alternative<double_t>(args[1]))) {
+    auto columns =
+        getSameTypeColumns(std::get<ComplexExpression>(args[0]).getDynamicArguments(), input);
+    if(!columns) {
+      return false;
+    }
+    auto& [slots, type] = *columns;
+    auto const constant = std::holds_alternative<int64_t>(args[1])
+                              ? Value(std::get<int64_t>(args[1]))
+                              : Value(std::get<double_t>(args[1]));
+    auto* kernel = findGreaterSumKernel(type, getType(constant), slots.size());
+    if(kernel == nullptr) {
+      return false;
+    }
+    program.emitKernelCall(kernel, std::move(slots), constant);
+    return true;
+  }
+  if(head == "Equal"_) {
+    auto columns = getSameTypeColumns(args, input);
+    if(!columns) {
+      return false;
+    }
+    auto& [slots, type] = *columns;
+    auto* kernel = findEqualKernel(type);
+    if(kernel == nullptr) {
+      return false;
+    }
+    program.emitKernelCall(kernel, std::move(slots));
+    return true;
+  }
+  return false;
+}
+
+void compilePredicate(ComplexExpression&& e, Program& program, Operator const& input) {
   if(e.getHead() == "Where"_) {
-    return toPredicate(boss::get<ComplexExpression>(
-                           *std::make_move_iterator(std::move(e).getDynamicArguments().begin())),
-                       input);
+    compilePredicate(boss::get<ComplexExpression>(
+                         *std::make_move_iterator(std::move(e).getDynamicArguments().begin())),
+                     program, input);
+    return;
   }
   auto [head, unused_, dynamics, unused2_] = std::move(e).decompose();
-  if(head == "Greater"_) {
-    auto it = std::make_move_iterator(dynamics.begin());
-    return [leftArg = toArithmeticOp(std::move(*it++), input),
-            rightArg = toArithmeticOp(std::move(*it++), input)](Tuple const& tuple) {
-      return leftArg(tuple) > rightArg(tuple);
-    };
+  if(compilePredicateKernelCall(head, dynamics, program, input)) {
+    return;
   }
-  if(head == "Equal"_) {
-    auto it = std::make_move_iterator(dynamics.begin());
-    return [leftArg = toArithmeticOp(std::move(*it++), input),
-            rightArg = toArithmeticOp(std::move(*it++), input)](Tuple const& tuple) {
-      return leftArg(tuple) == rightArg(tuple);
-    };
+  auto it = std::make_move_iterator(dynamics.begin());
+  if(head == "Greater"_ || head == "Equal"_) {
+    auto lhs = compileArithmetic(std::move(*it++), program, input);
+    auto rhs = compileArithmetic(std::move(*it++), program, input);
+    auto const type = getCommonType(lhs, rhs);
+    lhs = convertOperand(lhs, type, program);
+    rhs = convertOperand(rhs, type, program);
+    program.emit(typedOpCode(head == "Greater"_ ? OpCode::GreaterInt64 : OpCode::EqualInt64, type),
+                 0, lhs.slot, rhs.slot);
+    return;
   }
   if(head == "And"_) {
-    auto it = std::make_move_iterator(dynamics.begin());
-    return [leftArg = toPredicate(boss::get<ComplexExpression>(std::move(*it++)), input),
-            rightArg = toPredicate(boss::get<ComplexExpression>(std::move(*it++)), input)](
-               Tuple const& tuple) { return leftArg(tuple) && rightArg(tuple); };
+    // (the rows dropped by the first condition are not compared by the second one)
+    compilePredicate(boss::get<ComplexExpression>(std::move(*it++)), program, input);
+    compilePredicate(boss::get<ComplexExpression>(std::move(*it++)), program, input);
+    return;
   }
   throw std::runtime_error("Unknown predicate operator: " + head.getName());
 }
 
-} // namespace boss::engines::volcano
\ No newline at end of file
+/**
+ * Compiles a predicate (on the attributes of the input) into a program that filters the rows of
+ * a batch.
+ */
+Program toPredicateProgram(ComplexExpression&& e, Operator const& input) {
+  Program program(input.getSchema().size());
+  compilePredicate(std::move(e), program, input);
+  return program;
+}
+
+/// the columns that a join matches on: the left-side column keys[i].first with keys[i].second
+using EquiJoinKeys = std::vector<std::pair<size_t, size_t>>;
+
+/**
+ * Splits a join predicate into its conjuncts (through Where and And): the equalities between a
+ * column of each side become equi-join keys (as indices in the schema of each side), the other
+ * ones are returned as they are (to check on the matching rows).
+ */
+std::tuple<EquiJoinKeys, ExpressionArguments> toEquiJoinKeys(ComplexExpression&& e,
+                                                             Schema const& leftSchema,
+                                                             Schema const& rightSchema) {
+  EquiJoinKeys keys;
+  ExpressionArguments others;
+  auto indexIn = [](Schema const& schema, Expression const& arg) -> std::optional<size_t> {
+    if(!std::holds_alternative<Symbol>(arg)) {
+      return {};
+    }
+    auto it = std::find(schema.begin(), schema.end(), boss::get<Symbol>(arg).getName());
+    if(it == schema.end()) {
+      return {};
+    }
+    return std::distance(schema.begin(), it);
+  };
+  std::function<void(ComplexExpression&&)> split = [&](ComplexExpression&& conjunct) {
+    if(conjunct.getHead() == "Where"_ || conjunct.getHead() == "And"_) {
+      for(auto&& arg : std::move(conjunct).getDynamicArguments()) {
+        split(boss::get<ComplexExpression>(std::move(arg)));
+      }
+      return;
+    }
+    if(conjunct.getHead() == "Equal"_ && conjunct.getDynamicArguments().size() == 2) {
+      auto const& lhs = conjunct.getDynamicArguments()[0];
+      auto const& rhs = conjunct.getDynamicArguments()[1];
+      // (a symbol is looked up in the left side first, as in the schema of the join)
+      auto lhsLeft = indexIn(leftSchema, lhs);
+      auto rhsLeft = indexIn(leftSchema, rhs);
+      auto lhsRight = lhsLeft ? std::nullopt : indexIn(rightSchema, lhs);
+      auto rhsRight = rhsLeft ? std::nullopt : indexIn(rightSchema, rhs);
+      if(lhsLeft && rhsRight) {
+        keys.emplace_back(*lhsLeft, *rhsRight);
+        return;
+      }
+      if(rhsLeft && lhsRight) {
+        keys.emplace_back(*rhsLeft, *lhsRight);
+        return;
+      }
+    }
+    others.emplace_back(std::move(conjunct));
+  };
+  split(std::move(e));
+  return {std::move(keys), std::move(others)};
+}
+
+/// the predicate that all the conjuncts hold (they must not be empty)
+ComplexExpression toConjunction(ExpressionArguments&& conjuncts) {
+  auto it = std::make_move_iterator(conjuncts.rbegin());
+  auto conjunction = boss::get<ComplexExpression>(std::move(*it++));
+  for(; it != std::make_move_iterator(conjuncts.rend()); ++it) {
+    conjunction = "And"_(boss::get<ComplexExpression>(std::move(*it)), std::move(conjunction));
+  }
+  return "Where"_(std::move(conjunction));
+}
+
+} // namespace boss::engines::volcano
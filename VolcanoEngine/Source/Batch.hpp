@@ -0,0 +1,170 @@
+#pragma once
+
+#include "Types.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+namespace boss::engines::volcano {
+
+/// the number of rows that the operators pass on at once (their columns stay in cache)
+constexpr size_t batchSize = 2048;
+
+/**
+ * The values of one attribute for the rows of a batch. A column holds a single type whenever its
+ * values have the same one (the usual case), and falls back to variant values otherwise.
+ */
+using ColumnValues = std::variant<std::vector<int64_t>, std::vector<double_t>, std::vector<Value>>;
+
+/// the indices of the rows of a batch that are kept (e.g., by a selection), in ascending order
+using Selection = std::vector<uint32_t>;
+
+inline size_t getSize(ColumnValues const& column) {
+  return std::visit([](auto const& values) { return values.size(); }, column);
+}
+
+/// the type of the values of a column
+inline ColumnType getType(ColumnValues const& column) {
+  return static_cast<ColumnType>(column.index()); // (in the same order)
+}
+
+inline ColumnType getType(Value const& value) { return static_cast<ColumnType>(value.index()); }
+
+inline Value getValue(ColumnValues const& column, size_t row) {
+  return std::visit([row](auto const& values) -> Value { return values[row]; }, column);
+}
+
+/// appends a value to a column, changing its type if needed (empty, or to variant values)
+inline void appendValue(ColumnValues& column, Value const& value) {
+  std::visit(
+      [&column](auto const& typedValue) {
+        using T = std::decay_t<decltype(typedValue)>;
+        if(auto* values = std::get_if<std::vector<T>>(&column)) {
+          values->push_back(typedValue);
+          return;
+        }
+        if(auto* values = std::get_if<std::vector<Value>>(&column)) {
+          values->emplace_back(typedValue);
+          return;
+        }
+        if(getSize(column) == 0) {
+          column = std::vector<T>{typedValue};
+          return;
+        }
+        std::vector<Value> mixed;
+        std::visit([&mixed](auto const& values) { mixed.assign(values.begin(), values.end()); },
+                   column);
+        mixed.emplace_back(typedValue);
+        column = std::move(mixed);
+      },
+      value);
+}
+
+/// the values of a column, reset to a type and a size (reusing its memory when it has that type)
+template <typename T> std::vector<T>& resetValues(ColumnValues& column, size_t size) {
+  if(!std::holds_alternative<std::vector<T>>(column)) {
+    column = std::vector<T>();
+  }
+  auto& values = std::get<std::vector<T>>(column);
+  values.resize(size);
+  return values;
+}
+
+/// a column made of a single value, repeated
+inline ColumnValues repeatValue(Value const& value, size_t size) {
+  return std::visit(
+      [size](auto typedValue) -> ColumnValues {
+        return std::vector<std::decay_t<decltype(typedValue)>>(size, typedValue);
+      },
+      value);
+}
+
+/// the values of a column at some rows (in the order of the rows, which may repeat)
+inline ColumnValues gatherValues(ColumnValues const& column, Selection const& rows) {
+  return std::visit(
+      [&rows](auto const& values) -> ColumnValues {
+        std::decay_t<decltype(values)> gathered(rows.size());
+        for(size_t r = 0; r < rows.size(); r++) {
+          gathered[r] = values[rows[r]];
+        }
+        return gathered;
+      },
+      column);
+}
+
+/**
+ * A chunk of (at most about batchSize) rows, stored column by column: the unit of work of the
+ * operators' batch interface.
+ */
+struct Batch {
+  std::vector<ColumnValues> columns;
+
+  size_t size() const { return columns.empty() ? 0 : getSize(columns[0]); }
+  bool empty() const { return size() == 0; }
+
+  /// appends the selected rows of another batch (with the same attributes)
+  void appendRows(Batch const& other, Selection const& rows) {
+    if(columns.empty()) {
+      // same types as the other batch
+      for(auto const& column : other.columns) {
+        columns.push_back(std::visit(
+            [](auto const& values) -> ColumnValues { return std::decay_t<decltype(values)>(); },
+            column));
+      }
+    }
+    for(size_t i = 0; i < columns.size(); i++) {
+      std::visit(
+          [&rows, &column = columns[i]](auto const& values) {
+            using Values = std::decay_t<decltype(values)>;
+            if(auto* target = std::get_if<Values>(&column)) {
+              auto const offset = target->size();
+              target->resize(offset + rows.size());
+              for(size_t r = 0; r < rows.size(); r++) {
+                (*target)[offset + r] = values[rows[r]];
+              }
+            } else {
+              for(auto row : rows) {
+                appendValue(column, values[row]);
+              }
+            }
+          },
+          other.columns[i]);
+    }
+  }
+
+  /// keeps the selected rows only
+  void filter(Selection const& rows) {
+    if(rows.size() == size()) {
+      return;
+    }
+    for(auto& column : columns) {
+      column = gatherValues(column, rows);
+    }
+  }
+
+  /// the rows [begin, end) of the batch
+  Batch slice(size_t begin, size_t end) const {
+    Batch sliced;
+    sliced.columns.reserve(columns.size());
+    for(auto const& column : columns) {
+      sliced.columns.push_back(std::visit(
+          [begin, end](auto const& values) -> ColumnValues {
+            return std::decay_t<decltype(values)>(values.begin() + begin, values.begin() + end);
+          },
+          column));
+    }
+    return sliced;
+  }
+};
+
+/// all the rows of a batch
+inline Selection selectAll(Batch const& batch) {
+  Selection selection(batch.size());
+  for(size_t row = 0; row < selection.size(); row++) {
+    selection[row] = static_cast<uint32_t>(row);
+  }
+  return selection;
+}
+
+} // namespace boss::engines::volcano
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Batch.hpp"
+#include "Kernels.hpp"
+#include "Types.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace boss::engines::volcano {
+
+/**
+ * The operations of the bytecode that predicates and arithmetic expressions are compiled into.
+ * Each one runs over all the rows of a batch at once, on operands of the type in its name (the
+ * types are resolved when compiling): the dispatch costs once per batch, not once per value.
+ */
+enum class OpCode : uint8_t {
+  // conversions of the operand (lhs)
+  ToDouble,
+  ToMixed,
+  // the target gets lhs op rhs (for each row)
+  PlusInt64,
+  PlusDouble,
+  PlusMixed,
+  MultiplyInt64,
+  MultiplyDouble,
+  MultiplyMixed,
+  // the selection keeps the rows for which lhs op rhs holds
+  GreaterInt64,
+  GreaterDouble,
+  GreaterMixed,
+  EqualInt64,
+  EqualDouble,
+  EqualMixed,
+  // a call to a fused kernel (lhs: the index of the call), for the target or the selection
+  CallArithmeticKernel,
+  CallPredicateKernel,
+};
+
+/// the variant of an operation for operands of a type (they are declared in the same order)
+inline OpCode typedOpCode(OpCode int64Variant, ColumnType type) {
+  return static_cast<OpCode>(static_cast<uint8_t>(int64Variant) + static_cast<uint8_t>(type));
+}
+
+/**
+ * An operand, or the target of an instruction: the slots are the columns of the input batches,
+ * followed by the registers of the program.
+ */
+using Slot = uint32_t;
+
+struct Instruction {
+  OpCode code;
+  Slot target;
+  Slot lhs;
+  Slot rhs;
+};
+
+/**
+ * A compiled expression (see toArithmeticProgram and toPredicateProgram): the instructions, run
+ * in order, and their registers (kept across batches, so that they are only allocated once).
+ */
+class Program {
+public:
+  explicit Program(size_t numInputColumns) : numInputColumns(numInputColumns) {}
+
+  /// a new register for the results of an instruction
+  Slot addRegister() {
+    registers.emplace_back();
+    return static_cast<Slot>(numInputColumns + registers.size() - 1);
+  }
+
+  /// a new register holding a constant (repeated for all the rows)
+  Slot addConstant(Value value) {
+    auto const slot = addRegister();
+    constants.emplace_back(slot, value);
+    return slot;
+  }
+
+  void emit(OpCode code, Slot target, Slot lhs, Slot rhs = 0) {
+    instructions.push_back({code, target, lhs, rhs});
+  }
+
+  /// calls a fused kernel, on the values of the input slots (and a constant)
+  void emitKernelCall(ArithmeticKernel kernel, Slot target, std::vector<Slot>&& inputs,
+                      Value constant = {}) {
+    emit(OpCode::CallArithmeticKernel, target, static_cast<Slot>(kernelCalls.size()));
+    kernelCalls.push_back({kernel, nullptr, std::move(inputs), constant});
+  }
+  void emitKernelCall(PredicateKernel kernel, std::vector<Slot>&& inputs, Value constant = {}) {
+    emit(OpCode::CallPredicateKernel, 0, static_cast<Slot>(kernelCalls.size()));
+    kernelCalls.push_back({nullptr, kernel, std::move(inputs), constant});
+  }
+
+  /// whether the instructions can write to a slot (neither an input column nor a constant)
+  bool isTemporary(Slot slot) const {
+    return slot >= numInputColumns &&
+           std::find_if(constants.begin(), constants.end(),
+                        [slot](auto const& constant) { return constant.first == slot; }) ==
+               constants.end();
+  }
+
+  void setResult(Slot slot, ColumnType type) {
+    result = slot;
+    resultType = type;
+  }
+  ColumnType getResultType() const { return resultType; }
+
+  /// runs an arithmetic expression: the values of the result for all the rows of the batch
+  ColumnValues evaluate(Batch const& batch) {
+    run(batch, nullptr);
+    if(isTemporary(result)) {
+      return std::move(registers[result - numInputColumns]); // (allocated again for the next one)
+    }
+    return operand(batch, result);
+  }
+
+  /// runs a predicate: drops the rows of the batch that do not satisfy it from the selection
+  void filter(Batch const& batch, Selection& selection) { run(batch, &selection); }
+
+private:
+  size_t numInputColumns;
+  std::vector<Instruction> instructions;
+  std::vector<ColumnValues> registers;
+  std::vector<std::pair<Slot, Value>> constants;
+  size_t constantsSize = 0; // the number of rows that the constants are repeated for
+  Slot result = 0;
+  ColumnType resultType = ColumnType::Int64;
+
+  struct KernelCall {
+    ArithmeticKernel arithmeticKernel;
+    PredicateKernel predicateKernel;
+    std::vector<Slot> inputs;
+    Value constant;
+  };
+  std::vector<KernelCall> kernelCalls;
+  std::vector<ColumnValues const*> kernelInputs; // (reused by all the calls)
+
+  std::vector<ColumnValues const*> const& getKernelInputs(Batch const& batch,
+                                                          KernelCall const& call) {
+    kernelInputs.clear();
+    for(auto slot : call.inputs) {
+      kernelInputs.push_back(&operand(batch, slot));
+    }
+    return kernelInputs;
+  }
+
+  ColumnValues const& operand(Batch const& batch, Slot slot) const {
+    return slot < numInputColumns ? batch.columns[slot] : registers[slot - numInputColumns];
+  }
+
+  template <typename T> std::vector<T> const& typedOperand(Batch const& batch, Slot slot) const {
+    return std::get<std::vector<T>>(operand(batch, slot));
+  }
+
+  /// the values of a register, with that type and size (reusing its memory if it can)
+  template <typename T> std::vector<T>& target(Slot slot, size_t size) {
+    return resetValues<T>(registers[slot - numInputColumns], size);
+  }
+
+  template <typename T, typename Op>
+  void arithmetic(Batch const& batch, Instruction const& instruction, Op const& op) {
+    auto const& lhs = typedOperand<T>(batch, instruction.lhs);
+    auto const& rhs = typedOperand<T>(batch, instruction.rhs);
+    // (the target may be the lhs register: it already has the size of the batch)
+    auto& values = target<T>(instruction.target, batch.size());
+    for(size_t row = 0; row < values.size(); row++) {
+      values[row] = op(lhs[row], rhs[row]);
+    }
+  }
+
+  template <typename T, typename Compare>
+  void compare(Batch const& batch, Instruction const& instruction, Compare const& compare,
+               Selection& selection) const {
+    auto const& lhs = typedOperand<T>(batch, instruction.lhs);
+    auto const& rhs = typedOperand<T>(batch, instruction.rhs);
+    size_t kept = 0;
+    for(auto row : selection) {
+      if(compare(lhs[row], rhs[row])) {
+        selection[kept++] = row;
+      }
+    }
+    selection.resize(kept);
+  }
+
+  void run(Batch const& batch, Selection* selection) {
+    auto const size = batch.size();
+    if(size != constantsSize) {
+      for(auto const& [slot, value] : constants) {
+        registers[slot - numInputColumns] = repeatValue(value, size);
+      }
+      constantsSize = size;
+    }
+    auto const plus = [](auto lhs, auto rhs) { return lhs + rhs; };
+    auto const multiply = [](auto lhs, auto rhs) { return lhs * rhs; };
+    auto const greater = [](auto const& lhs, auto const& rhs) { return lhs > rhs; };
+    auto const equal = [](auto const& lhs, auto const& rhs) { return lhs == rhs; };
+    for(auto const& instruction : instructions) {
+      switch(instruction.code) {
+      case OpCode::ToDouble: {
+        auto const& values = typedOperand<int64_t>(batch, instruction.lhs);
+        auto& converted = target<double_t>(instruction.target, size);
+        for(size_t row = 0; row < size; row++) {
+          converted[row] = static_cast<double_t>(values[row]);
+        }
+        break;
+      }
+      case OpCode::ToMixed: {
+        // (the values of a mixed column may come in a single type, e.g., after a selection)
+        auto converted = std::visit(
+            [](auto const& values) { return std::vector<Value>(values.begin(), values.end()); },
+            operand(batch, instruction.lhs));
+        registers[instruction.target - numInputColumns] = std::move(converted);
+        break;
+      }
+      case OpCode::PlusInt64: arithmetic<int64_t>(batch, instruction, plus); break;
+      case OpCode::PlusDouble: arithmetic<double_t>(batch, instruction, plus); break;
+      case OpCode::PlusMixed: arithmetic<Value>(batch, instruction, plus); break;
+      case OpCode::MultiplyInt64: arithmetic<int64_t>(batch, instruction, multiply); break;
+      case OpCode::MultiplyDouble: arithmetic<double_t>(batch, instruction, multiply); break;
+      case OpCode::MultiplyMixed: arithmetic<Value>(batch, instruction, multiply); break;
+      case OpCode::GreaterInt64: compare<int64_t>(batch, instruction, greater, *selection); break;
+      case OpCode::GreaterDouble: compare<double_t>(batch, instruction, greater, *selection); break;
+      case OpCode::GreaterMixed: compare<Value>(batch, instruction, greater, *selection); break;
+      case OpCode::EqualInt64: compare<int64_t>(batch, instruction, equal, *selection); break;
+      case OpCode::EqualDouble: compare<double_t>(batch, instruction, equal, *selection); break;
+      case OpCode::EqualMixed: compare<Value>(batch, instruction, equal, *selection); break;
+      case OpCode::CallArithmeticKernel: {
+        auto const& call = kernelCalls[instruction.lhs];
+        call.arithmeticKernel(getKernelInputs(batch, call), call.constant, size,
+                              registers[instruction.target - numInputColumns]);
+        break;
+      }
+      case OpCode::CallPredicateKernel: {
+        auto const& call = kernelCalls[instruction.lhs];
+        call.predicateKernel(getKernelInputs(batch, call), call.constant, *selection);
+        break;
+      }
+      default: throw std::runtime_error("Unknown bytecode operation");
+      }
+    }
+  }
+};
+
+} // namespace boss::engines::volcano
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "Batch.hpp"
+#include "Types.hpp"
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace boss::engines::volcano {
+
+/**
+ * The fused kernels: the most common shapes of expressions, each compiled into a single loop over
+ * the rows of a batch (with the types of its columns and their number known at compile time).
+ * The expression compiler looks them up in the registry below, and falls back to the generic
+ * bytecode for anything else (e.g., columns of different types).
+ */
+
+/// computes a column from the input columns (all of the same type)
+using ArithmeticKernel = void (*)(std::vector<ColumnValues const*> const& inputs,
+                                  Value const& constant, size_t size, ColumnValues& result);
+/// drops the rows that do not satisfy a predicate on the input columns (and a constant)
+using PredicateKernel = void (*)(std::vector<ColumnValues const*> const& inputs,
+                                 Value const& constant, Selection& selection);
+
+/// the largest number of columns that the kernels are specialized for
+constexpr size_t maxKernelArity = 8;
+
+namespace kernels {
+
+template <typename T, size_t Arity>
+std::array<T const*, Arity> getTypedInputs(std::vector<ColumnValues const*> const& inputs) {
+  std::array<T const*, Arity> columns{};
+  for(size_t i = 0; i < Arity; i++) {
+    columns[i] = std::get<std::vector<T>>(*inputs[i]).data();
+  }
+  return columns;
+}
+
+/// the sum of the columns at a row (added from left to right, as by the generic Plus)
+template <typename T, size_t Arity, size_t... I>
+T sumRow(std::array<T const*, Arity> const& columns, size_t row,
+         std::index_sequence<I...> /*unused*/) {
+  return (... + columns[I][row]);
+}
+
+/// Plus(c1, ..., cn)
+template <typename T, size_t Arity>
+void sum(std::vector<ColumnValues const*> const& inputs, Value const& /*constant*/, size_t size,
+         ColumnValues& result) {
+  auto const columns = getTypedInputs<T, Arity>(inputs);
+  auto& values = resetValues<T>(result, size);
+  for(size_t row = 0; row < size; row++) {
+    values[row] = sumRow(columns, row, std::make_index_sequence<Arity>());
+  }
+}
+
+/// Greater(Plus(c1, ..., cn), constant)
+template <typename T, typename Constant, size_t Arity>
+void greaterSum(std::vector<ColumnValues const*> const& inputs, Value const& constant,
+                Selection& selection) {
+  auto const columns = getTypedInputs<T, Arity>(inputs);
+  auto const threshold = std::get<Constant>(constant);
+  size_t kept = 0;
+  for(auto row : selection) {
+    // (the row is kept or not by moving the next position forward, without a branch)
+    selection[kept] = row;
+    kept += sumRow(columns, row, std::make_index_sequence<Arity>()) > threshold;
+  }
+  selection.resize(kept);
+}
+
+/// Equal(colA, colB)
+template <typename T>
+void equal(std::vector<ColumnValues const*> const& inputs, Value const& /*constant*/,
+           Selection& selection) {
+  auto const columns = getTypedInputs<T, 2>(inputs);
+  size_t kept = 0;
+  for(auto row : selection) {
+    selection[kept] = row;
+    kept += columns[0][row] == columns[1][row];
+  }
+  selection.resize(kept);
+}
+
+template <typename T, size_t... Arity>
+constexpr std::array<ArithmeticKernel, sizeof...(Arity)>
+sumKernels(std::index_sequence<Arity...> /*unused*/) {
+  return {&sum<T, Arity + 1>...};
+}
+
+template <typename T, typename Constant, size_t... Arity>
+constexpr std::array<PredicateKernel, sizeof...(Arity)>
+greaterSumKernels(std::index_sequence<Arity...> /*unused*/) {
+  return {&greaterSum<T, Constant, Arity + 1>...};
+}
+
+} // namespace kernels
+
+/// the kernel for Plus(c1, ..., cn), if there is one for the type and the number of columns
+inline ArithmeticKernel findSumKernel(ColumnType type, size_t arity) {
+  constexpr auto arities = std::make_index_sequence<maxKernelArity>();
+  static constexpr auto int64Kernels = kernels::sumKernels<int64_t>(arities);
+  static constexpr auto doubleKernels = kernels::sumKernels<double_t>(arities);
+  if(arity == 0 || arity > maxKernelArity || type == ColumnType::Mixed) {
+    return nullptr;
+  }
+  return (type == ColumnType::Int64 ? int64Kernels : doubleKernels)[arity - 1];
+}
+
+/// the kernel for Greater(Plus(c1, ..., cn), constant), if there is one for the types and arity
+inline PredicateKernel findGreaterSumKernel(ColumnType type, ColumnType constantType,
+                                            size_t arity) {
+  using kernels::greaterSumKernels;
+  constexpr auto arities = std::make_index_sequence<maxKernelArity>();
+  // (indexed by the type of the columns, then by the type of the constant)
+  static constexpr std::array<std::array<std::array<PredicateKernel, maxKernelArity>, 2>, 2>
+      typedKernels = {{{greaterSumKernels<int64_t, int64_t>(arities),
+                        greaterSumKernels<int64_t, double_t>(arities)},
+                       {greaterSumKernels<double_t, int64_t>(arities),
+                        greaterSumKernels<double_t, double_t>(arities)}}};
+  if(arity == 0 || arity > maxKernelArity || type == ColumnType::Mixed ||
+     constantType == ColumnType::Mixed) {
+    return nullptr;
+  }
+  return typedKernels[static_cast<size_t>(type)][static_cast<size_t>(constantType)][arity - 1];
+}
+
+/// the kernel for Equal(colA, colB), if there is one for the type of the columns
+inline PredicateKernel findEqualKernel(ColumnType type) {
+  switch(type) {
+  case ColumnType::Int64: return &kernels::equal<int64_t>;
+  case ColumnType::Double: return &kernels::equal<double_t>;
+  default: return nullptr;
+  }
+}
+
+} // namespace boss::engines::volcano
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "../BOSSExpressionConversions.hpp"
+#include "Join.hpp"
+#include "Operator.hpp"
+#include <cstring>
+#include <limits>
+#include <memory>
+
+namespace boss::engines::volcano::operators {
+
+/**
+ * A join on equalities between columns of each side (and, optionally, other conditions checked
+ * on the matching rows).
+ *
+ * The right-side relation is hashed on its key columns (chaining the rows of each bucket), and
+ * the left-side batches are streamed through it: the matching rows come out in the same order as
+ * with the nested loop join.
+ */
+class HashJoin : public Operator {
+public:
+  HashJoin(std::unique_ptr<Operator>&& left, std::unique_ptr<Operator>&& right,
+           EquiJoinKeys&& joinKeys, std::optional<ComplexExpression>&& residualExpr)
+      : schema(Join::buildSchema(left->getSchema(), right->getSchema())),
+        types(Join::buildSchema(left->getColumnTypes(), right->getColumnTypes())),
+        leftInput(std::move(left)), keys(std::move(joinKeys)) {
+    if(residualExpr) {
+      residual = toPredicateProgram(std::move(*residualExpr), *this);
+    }
+    // already build the hash table of the right-side relation
+    while(auto rightBatch = right->nextBatch()) {
+      rightTuples.appendRows(*rightBatch, selectAll(*rightBatch));
+    }
+    if(rightTuples.empty()) {
+      return; // (nothing matches: there may not even be columns to hash)
+    }
+    rightHashes = hashKeys(rightTuples, false);
+    size_t numBuckets = 1;
+    while(numBuckets < 2 * rightTuples.size()) {
+      numBuckets *= 2;
+    }
+    bucketMask = numBuckets - 1;
+    buckets.assign(numBuckets, noRow);
+    nextInBucket.resize(rightTuples.size());
+    // (inserted backwards, so that the rows of a bucket are chained in ascending order)
+    for(auto row = rightTuples.size(); row-- > 0;) {
+      auto& head = buckets[rightHashes[row] & bucketMask];
+      nextInBucket[row] = head;
+      head = static_cast<uint32_t>(row);
+    }
+  }
+
+  std::optional<Batch> nextBatch() override {
+    if(rightTuples.empty()) {
+      return {};
+    }
+    while(true) {
+      if(!currentLeftBatch || currentLeftRow == currentLeftBatch->size()) {
+        // get (and hash) the next left-side batch
+        currentLeftBatch = leftInput->nextBatch();
+        if(!currentLeftBatch) {
+          return {};
+        }
+        leftHashes = hashKeys(*currentLeftBatch, true);
+        currentLeftRow = 0;
+        nextRightRow = currentLeftBatch->empty() ? noRow : buckets[leftHashes[0] & bucketMask];
+      }
+      Selection leftRows;
+      Selection rightRows;
+      probe(leftRows, rightRows);
+      if(leftRows.empty()) {
+        continue;
+      }
+      Batch output;
+      output.columns.reserve(schema.size());
+      for(auto const& column : currentLeftBatch->columns) {
+        output.columns.push_back(gatherValues(column, leftRows));
+      }
+      for(auto const& column : rightTuples.columns) {
+        output.columns.push_back(gatherValues(column, rightRows));
+      }
+      if(residual) {
+        auto selection = selectAll(output);
+        residual->filter(output, selection);
+        output.filter(selection);
+      }
+      if(!output.empty()) {
+        return output;
+      }
+    }
+  }
+
+  Schema const& getSchema() const override { return schema; }
+  ColumnTypes const& getColumnTypes() const override { return types; }
+
+private:
+  static constexpr uint32_t noRow = std::numeric_limits<uint32_t>::max();
+
+  Schema schema; // new schema merging from left and right schemas
+  ColumnTypes types;
+  std::unique_ptr<Operator> leftInput;
+  EquiJoinKeys keys;
+  std::optional<Program> residual;
+  // the right-side tuples, the hash of their keys, and the rows of each bucket (as linked lists)
+  Batch rightTuples;
+  std::vector<uint64_t> rightHashes;
+  std::vector<uint32_t> buckets;
+  std::vector<uint32_t> nextInBucket;
+  uint64_t bucketMask = 0;
+  // the left-side batch being probed, and the next candidate (in the bucket of the current row)
+  std::optional<Batch> currentLeftBatch;
+  std::vector<uint64_t> leftHashes;
+  size_t currentLeftRow = 0;
+  uint32_t nextRightRow = noRow;
+
+  /// matches the rows of the current left-side batch, until about batchSize matching pairs
+  void probe(Selection& leftRows, Selection& rightRows) {
+    while(currentLeftRow < currentLeftBatch->size()) {
+      for(; nextRightRow != noRow; nextRightRow = nextInBucket[nextRightRow]) {
+        if(leftRows.size() == batchSize) {
+          return; // (resumed from the same candidate at the next call)
+        }
+        if(rightHashes[nextRightRow] == leftHashes[currentLeftRow] &&
+           keysEqual(currentLeftRow, nextRightRow)) {
+          leftRows.push_back(static_cast<uint32_t>(currentLeftRow));
+          rightRows.push_back(nextRightRow);
+        }
+      }
+      if(++currentLeftRow < currentLeftBatch->size()) {
+        nextRightRow = buckets[leftHashes[currentLeftRow] & bucketMask];
+      }
+    }
+  }
+
+  bool keysEqual(size_t leftRow, size_t rightRow) const {
+    for(auto const& [leftColumn, rightColumn] : keys) {
+      if(!(getValue(currentLeftBatch->columns[leftColumn], leftRow) ==
+           getValue(rightTuples.columns[rightColumn], rightRow))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * @brief The hash of the keys of each row of a batch.
+   *
+   * The values are hashed as doubles, so that the integers and the doubles that are equal (as
+   * compared by the predicates) have the same hash.
+   */
+  std::vector<uint64_t> hashKeys(Batch const& batch, bool leftSide) const {
+    std::vector<uint64_t> hashes(batch.size(), 0);
+    for(auto const& key : keys) {
+      std::visit(
+          [&hashes](auto const& values) {
+            for(size_t row = 0; row < hashes.size(); row++) {
+              hashes[row] = mix(hashes[row] ^ hashValue(values[row]));
+            }
+          },
+          batch.columns[leftSide ? key.first : key.second]);
+    }
+    return hashes;
+  }
+
+  static uint64_t hashValue(Value const& value) {
+    return std::visit([](auto typedValue) { return hashValue(typedValue); }, value);
+  }
+  template <typename T> static uint64_t hashValue(T value) {
+    auto asDouble = static_cast<double>(value) + 0.0; // (-0.0 equals 0.0)
+    uint64_t bits = 0;
+    std::memcpy(&bits, &asDouble, sizeof(bits));
+    return bits;
+  }
+
+  /// the finalizer of MurmurHash3 (so that the low bits, which select the bucket, are mixed)
+  static uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;            // NOLINT(readability-magic-numbers)
+    hash *= 0xff51afd7ed558ccdULL; // NOLINT(readability-magic-numbers)
+    hash ^= hash >> 33;            // NOLINT(readability-magic-numbers)
+    hash *= 0xc4ceb9fe1a85ec53ULL; // NOLINT(readability-magic-numbers)
+    return hash ^ (hash >> 33);    // NOLINT(readability-magic-numbers)
+  }
+};
+
+} // namespace boss::engines::volcano::operators
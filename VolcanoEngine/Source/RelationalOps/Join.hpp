@@ -10,53 +10,87 @@ class Join : public Operator {
 public:
   Join(std::unique_ptr<Operator>&& left, std::unique_ptr<Operator>&& right,
        ComplexExpression&& predExpr)
-      : schema(buildSchema(left->getSchema(), right->getSchema())), leftInput(std::move(left)),
-        currentLeftTuple(*leftInput->next()), predicate(toPredicate(std::move(predExpr), *this)) {
-    // already build tuples from the right-side relation (cached for multiple iterations)
-    while(auto rightTuple = right->next()) {
-      rightTuples.emplace_back(std::move(*rightTuple));
+      : schema(buildSchema(left->getSchema(), right->getSchema())),
+        types(buildSchema(left->getColumnTypes(), right->getColumnTypes())),
+        leftInput(std::move(left)), predicate(toPredicateProgram(std::move(predExpr), *this)) {
+    // already build the batch of the right-side relation (cached for multiple iterations)
+    while(auto rightBatch = right->nextBatch()) {
+      rightTuples.appendRows(*rightBatch, selectAll(*rightBatch));
     }
-    rightTuplesIt = rightTuples.begin();
   }
 
-  std::optional<Tuple> next() override {
+  std::optional<Batch> nextBatch() override {
+    if(rightTuples.empty()) {
+      return {}; // (nothing matches)
+    }
     while(true) {
-      if(rightTuplesIt == rightTuples.end()) {
-        // rewind the right-side tuples and get the next left-side tuple
-        rightTuplesIt = rightTuples.begin();
-        auto nextLeftTuple = leftInput->next();
-        if(!nextLeftTuple) {
+      if(!currentLeftBatch || currentLeftRow == currentLeftBatch->size()) {
+        // get the next left-side batch
+        currentLeftBatch = leftInput->nextBatch();
+        currentLeftRow = 0;
+        rightTuplesBegin = 0;
+        if(!currentLeftBatch) {
           return {};
         }
-        currentLeftTuple = std::move(*nextLeftTuple);
+        continue;
+      }
+      // pair the left-side tuples with the right-side ones, until about batchSize candidates
+      Selection leftRows;
+      Selection rightRows;
+      while(leftRows.size() < batchSize && currentLeftRow < currentLeftBatch->size()) {
+        auto const rightTuplesEnd =
+            std::min(rightTuples.size(), rightTuplesBegin + batchSize - leftRows.size());
+        for(auto row = rightTuplesBegin; row < rightTuplesEnd; row++) {
+          leftRows.push_back(static_cast<uint32_t>(currentLeftRow));
+          rightRows.push_back(static_cast<uint32_t>(row));
+        }
+        rightTuplesBegin = rightTuplesEnd;
+        if(rightTuplesBegin == rightTuples.size()) {
+          // rewind the right-side tuples and get the next left-side tuple
+          currentLeftRow++;
+          rightTuplesBegin = 0;
+        }
+      }
+      // gather the candidates (from both sides, as the hash join does), and check the condition
+      Batch candidates;
+      candidates.columns.reserve(schema.size());
+      for(auto const& column : currentLeftBatch->columns) {
+        candidates.columns.push_back(gatherValues(column, leftRows));
+      }
+      for(auto const& column : rightTuples.columns) {
+        candidates.columns.push_back(gatherValues(column, rightRows));
       }
-      // build the next candidate with the current left-side tuple + the next right-side tuple
-      auto const& currentRightTuple = *rightTuplesIt++;
-      auto candidate = currentLeftTuple;
-      candidate.insert(candidate.end(), currentRightTuple.begin(), currentRightTuple.end());
-      // check the join condition
-      if(predicate(candidate)) {
-        return candidate;
+      auto selection = selectAll(candidates);
+      predicate.filter(candidates, selection);
+      candidates.filter(selection);
+      if(!candidates.empty()) {
+        return candidates;
       }
     }
   }
 
   Schema const& getSchema() const override { return schema; }
+  ColumnTypes const& getColumnTypes() const override { return types; }
 
-private:
-  Schema schema; // new schema merging from left and right schemas
-  static Schema buildSchema(Schema const& leftSchema, Schema const& rightSchema) {
-    Schema schema;
+  /// (also used for the column types)
+  template <typename Attributes>
+  static Attributes buildSchema(Attributes const& leftSchema, Attributes const& rightSchema) {
+    Attributes schema;
     schema.insert(schema.end(), leftSchema.begin(), leftSchema.end());
     schema.insert(schema.end(), rightSchema.begin(), rightSchema.end());
     return schema;
   }
+
+private:
+  Schema schema; // new schema merging from left and right schemas
+  ColumnTypes types;
   std::unique_ptr<Operator> leftInput;
-  Tuple currentLeftTuple;
-  Predicate predicate;
-  // for caching the right side tuples:
-  std::vector<Tuple> rightTuples;
-  std::vector<Tuple>::iterator rightTuplesIt;
+  std::optional<Batch> currentLeftBatch;
+  size_t currentLeftRow = 0;
+  Program predicate;
+  // for caching the right side tuples (and the next ones to join with the current left tuple):
+  Batch rightTuples;
+  size_t rightTuplesBegin = 0;
 };
 
-} // namespace boss::engines::volcano::operators
\ No newline at end of file
+} // namespace boss::engines::volcano::operators
@@ -1,13 +1,39 @@
 #pragma once
 
+#include "../Batch.hpp"
+#include "../Row.hpp"
 #include "../Types.hpp"
 #include <optional>
+#include <stdexcept>
 
 namespace boss::engines::volcano::operators {
 
 class Operator {
 public:
-  virtual std::optional<Tuple> next() = 0;
+  /**
+   * @brief The next rows, as a batch of at most about batchSize rows (nothing at the end).
+   *
+   * The operators of the engine are batch at a time and override it. By default, the batch is
+   * filled with the rows of next(), for an operator implemented a tuple at a time.
+   */
+  virtual std::optional<Batch> nextBatch() {
+    if(!rowLayout) {
+      rowLayout.emplace(getColumnTypes());
+    }
+    auto batch = rowLayout->newBatch();
+    size_t numRows = 0;
+    for(; numRows < batchSize; numRows++) {
+      auto const* row = next();
+      if(row == nullptr) {
+        break;
+      }
+      rowLayout->appendTo(batch, row);
+    }
+    if(numRows == 0) {
+      return {};
+    }
+    return batch;
+  }
 
   Operator() = default;          // acts as open()
   virtual ~Operator() = default; // acts as close()
@@ -15,6 +41,23 @@ public:
   // not strictly belonging here,
   // but convenient for getting the schema changes along the pipeline (i.e., projections and joins)
   virtual Schema const& getSchema() const = 0;
+  /// the types of the attributes of the schema (the batches' columns have these types)
+  virtual ColumnTypes const& getColumnTypes() const = 0;
+
+protected:
+  /**
+   * @brief The next row of a tuple-at-a-time operator, in the RowLayout of the column types
+   * (nullptr at the end).
+   *
+   * The row is owned by the operator, and valid until the next call. It is only called by the
+   * default nextBatch(): the consumers call nextBatch().
+   */
+  virtual RowSlot const* next() {
+    throw std::runtime_error("an operator must implement either nextBatch() or next()");
+  }
+
+private:
+  std::optional<RowLayout> rowLayout; // (of the rows of next(), once the first batch is filled)
 };
 
 } // namespace boss::engines::volcano::operators
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../BOSSExpressionConversions.hpp"
 #include "Operator.hpp"
 #include "../Types.hpp"
 #include <memory>
@@ -8,22 +9,35 @@ namespace boss::engines::volcano::operators {
 
 class Project : public Operator {
 public:
-  Project(std::unique_ptr<Operator>&& op, Schema&& schema, Projection&& proj)
-      : input(std::move(op)), schema(std::move(schema)), projection(std::move(proj)) {}
+  Project(std::unique_ptr<Operator>&& op, Schema&& schema,
+          std::vector<Program>&& projectors)
+      : input(std::move(op)), projectors(std::move(projectors)), schema(std::move(schema)) {
+    for(auto const& projector : this->projectors) {
+      types.push_back(projector.getResultType());
+    }
+  }
 
-  std::optional<Tuple> next() override {
-    if(auto tuple = input->next()) {
-      return projection(*tuple);
+  std::optional<Batch> nextBatch() override {
+    auto batch = input->nextBatch();
+    if(!batch) {
+      return {};
+    }
+    Batch projected;
+    projected.columns.reserve(projectors.size());
+    for(auto& projector : projectors) {
+      projected.columns.emplace_back(projector.evaluate(*batch));
     }
-    return {};
+    return projected;
   }
 
   Schema const& getSchema() const override { return schema; }
+  ColumnTypes const& getColumnTypes() const override { return types; }
 
 private:
   std::unique_ptr<Operator> input;
-  Projection projection;
+  std::vector<Program> projectors; // one per attribute of the new schema
   Schema schema; // new schema after projections
+  ColumnTypes types;
 };
 
 } // namespace boss::engines::volcano::operators
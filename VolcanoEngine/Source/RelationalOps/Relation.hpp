@@ -1,28 +1,37 @@
 #pragma once
 
 #include "Operator.hpp"
+#include <algorithm>
 #include <vector>
 
 namespace boss::engines::volcano::operators {
 
 class Relation : public Operator {
 public:
-  Relation(Schema&& s, std::vector<Tuple>&& d)
-      : schema(std::move(s)), data(std::move(d)), dataIt(data.begin()) {}
+  Relation(Schema&& s, Batch&& d) : schema(std::move(s)), data(std::move(d)) {
+    for(auto const& column : data.columns) {
+      types.push_back(getType(column));
+    }
+  }
 
-  std::optional<Tuple> next() override {
-    if(dataIt != data.end()) {
-      return *dataIt++;
+  std::optional<Batch> nextBatch() override {
+    if(position == data.size()) {
+      return {};
     }
-    return {};
+    auto const end = std::min(data.size(), position + batchSize);
+    auto batch = data.slice(position, end);
+    position = end;
+    return batch;
   }
 
   Schema const& getSchema() const override { return schema; }
+  ColumnTypes const& getColumnTypes() const override { return types; }
 
 private:
   Schema schema;
-  std::vector<Tuple> data;
-  std::vector<Tuple>::iterator dataIt;
+  ColumnTypes types;
+  Batch data; // all the rows of the relation, column by column
+  size_t position = 0;
 };
 
-} // namespace boss::engines::volcano::operators
\ No newline at end of file
+} // namespace boss::engines::volcano::operators
@@ -9,22 +9,30 @@ namespace boss::engines::volcano::operators {
 class Select : public Operator {
 public:
   Select(std::unique_ptr<Operator>&& op, ComplexExpression&& predExpr)
-      : input(std::move(op)), predicate(toPredicate(std::move(predExpr), *input)) {}
+      : input(std::move(op)), predicate(toPredicateProgram(std::move(predExpr), *input)) {}
 
-  std::optional<Tuple> next() override {
-    while(auto candidate = input->next()) {
-      if(predicate(*candidate)) {
-        return candidate;
+  std::optional<Batch> nextBatch() override {
+    while(auto candidates = input->nextBatch()) {
+      auto selection = selectAll(*candidates);
+      predicate.filter(*candidates, selection);
+      if(selection.size() == candidates->size()) {
+        return candidates;
+      }
+      if(!selection.empty()) {
+        Batch selected;
+        selected.appendRows(*candidates, selection);
+        return selected;
       }
     }
     return {};
   }
 
   Schema const& getSchema() const override { return input->getSchema(); }
+  ColumnTypes const& getColumnTypes() const override { return input->getColumnTypes(); }
 
 private:
   std::unique_ptr<Operator> input;
-  Predicate predicate;
+  Program predicate;
 };
 
-} // namespace boss::engines::volcano::operators
\ No newline at end of file
+} // namespace boss::engines::volcano::operators
@@ -1,58 +1,87 @@
 #pragma once
 
 #include "../BOSSExpressionConversions.hpp"
+#include "../Row.hpp"
 #include "Operator.hpp"
 #include <algorithm>
 #include <memory>
+#include <memory_resource>
 #include <vector>
 
 namespace boss::engines::volcano::operators {
 
 class Top : public Operator {
 public:
-  Top(std::unique_ptr<Operator>&& op, int64_t n, ComplexExpression&& orderExpr)
-      : input(std::move(op)), maxN(n), orderOp(toArithmeticOp(std::move(orderExpr), *input)) {
-    // already build the output tuples
-    auto comp = [this](auto const& lhs, auto const& rhs) { return orderOp(lhs) > orderOp(rhs); };
-    while(auto candidate = input->next()) {
-      output.emplace_back(std::move(*candidate));
-      if(output.size() <= maxN) {
-        if(output.size() == maxN) {
-          // make it a heap on the inversed order, so the smallest (to pop) is always in the
-          // front
-          std::make_heap(output.begin(), output.end(), comp);
+  Top(std::unique_ptr<Operator>&& op, int64_t n, ComplexExpression&& orderExpr,
+      std::pmr::memory_resource& arena)
+      : input(std::move(op)), maxN(n), orderOp(toArithmeticProgram(std::move(orderExpr), *input)),
+        layout(input->getColumnTypes()), rows(&arena) {
+    // already select the top rows
+    // (with the order value computed once per row, for a whole batch at once)
+    auto comp = [](auto const& lhs, auto const& rhs) { return lhs.first > rhs.first; };
+    auto const numTop = static_cast<size_t>(std::max<int64_t>(maxN, 0));
+    RowSlot* spareRow = nullptr; // (to store a candidate before popping the smallest row)
+    while(auto candidates = input->nextBatch()) {
+      auto const orderValues = orderOp.evaluate(*candidates);
+      for(size_t row = 0; row < candidates->size(); row++) {
+        auto orderValue = getValue(orderValues, row);
+        if(output.size() == numTop && (numTop == 0 || !(orderValue > output.front().first))) {
+          // (the smallest is in the front: the candidate would be popped right away)
+          continue;
         }
-        // if we haven't reached the max number of tuples, nothing else to do
-        continue;
+        auto* slots = output.size() < numTop || spareRow == nullptr
+                          ? rows.allocate(layout.getWidth())
+                          : spareRow;
+        layout.store(*candidates, row, slots);
+        output.emplace_back(std::move(orderValue), slots);
+        if(output.size() <= numTop) {
+          if(output.size() == numTop) {
+            // make it a heap on the inversed order, so the smallest (to pop) is always in the
+            // front
+            std::make_heap(output.begin(), output.end(), comp);
+          }
+          // if we haven't reached the max number of rows, nothing else to do
+          continue;
+        }
+        // push the new element, pop the smallest (and keep its row for the next candidate)
+        std::push_heap(output.begin(), output.end(), comp);
+        std::pop_heap(output.begin(), output.end(), comp);
+        spareRow = output.back().second;
+        output.pop_back();
       }
-      // push the new element, pop the smallest
-      std::push_heap(output.begin(), output.end(), comp);
-      std::pop_heap(output.begin(), output.end(), comp);
-      output.pop_back();
     }
-    if(output.size() < maxN) {
-      // if we haven't reach the max number of tuples, we still need to make it a heap
+    if(output.size() < numTop) {
+      // if we haven't reach the max number of rows, we still need to make it a heap
       std::make_heap(output.begin(), output.end(), comp);
     }
     std::sort_heap(output.begin(), output.end(), comp);
     outputIt = output.begin();
   }
 
-  std::optional<Tuple> next() override {
+  std::optional<Batch> nextBatch() override {
     if(outputIt == output.end()) {
       return {};
     }
-    return std::move(*outputIt++);
+    auto batch = layout.newBatch();
+    for(auto end = outputIt + std::min<size_t>(batchSize, output.end() - outputIt);
+        outputIt != end; ++outputIt) {
+      layout.appendTo(batch, outputIt->second);
+    }
+    return batch;
   }
 
   Schema const& getSchema() const override { return input->getSchema(); }
+  ColumnTypes const& getColumnTypes() const override { return input->getColumnTypes(); }
 
 private:
   std::unique_ptr<Operator> input;
   int64_t maxN;
-  ArithmeticOp orderOp;
-  std::vector<Tuple> output;
-  std::vector<Tuple>::iterator outputIt;
+  Program orderOp;
+  // the top rows (allocated from the arena of the query), along with their order value
+  RowLayout layout;
+  std::pmr::polymorphic_allocator<RowSlot> rows;
+  std::vector<std::pair<Value, RowSlot*>> output;
+  std::vector<std::pair<Value, RowSlot*>>::iterator outputIt;
 };
 
-} // namespace boss::engines::volcano::operators
\ No newline at end of file
+} // namespace boss::engines::volcano::operators
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Batch.hpp"
+#include "Types.hpp"
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+namespace boss::engines::volcano {
+
+/// a value in a row: its type is not stored, but known from the column types of the schema
+union RowSlot {
+  int64_t asInt64;
+  double_t asDouble;
+};
+
+/**
+ * The layout of fixed-width rows for the column types of a schema: a slot per attribute (and, for
+ * an attribute of mixed type, a second one for the type of its value).
+ *
+ * The rows are plain arrays of slots, allocated in bulk (e.g., by Top, from the arena of a query)
+ * instead of one vector of variants per row. Tuple-at-a-time operators return their rows in this
+ * layout too (see Operator::next()).
+ */
+class RowLayout {
+public:
+  explicit RowLayout(ColumnTypes const& types) : types(types) {
+    for(auto type : types) {
+      offsets.push_back(width);
+      width += type == ColumnType::Mixed ? 2 : 1;
+    }
+  }
+
+  /// the number of slots of a row
+  size_t getWidth() const { return width; }
+
+  /// stores a row of a batch (with columns of the types of the layout) into the slots of a row
+  void store(Batch const& batch, size_t row, RowSlot* slots) const {
+    for(size_t column = 0; column < types.size(); column++) {
+      std::visit([&](auto const& values) { store(values[row], column, slots); },
+                 batch.columns[column]);
+    }
+  }
+
+  Value load(RowSlot const* slots, size_t column) const {
+    auto const* slot = slots + offsets[column];
+    auto const type = types[column] == ColumnType::Mixed ? static_cast<ColumnType>(slot[1].asInt64)
+                                                         : types[column];
+    return type == ColumnType::Int64 ? Value(slot->asInt64) : Value(slot->asDouble);
+  }
+
+  /// an empty batch, with columns of the types of the layout
+  Batch newBatch() const {
+    Batch batch;
+    for(auto type : types) {
+      switch(type) {
+      case ColumnType::Int64: batch.columns.emplace_back(std::vector<int64_t>()); break;
+      case ColumnType::Double: batch.columns.emplace_back(std::vector<double_t>()); break;
+      case ColumnType::Mixed: batch.columns.emplace_back(std::vector<Value>()); break;
+      }
+    }
+    return batch;
+  }
+
+  /// appends a row to a batch (created by newBatch())
+  void appendTo(Batch& batch, RowSlot const* slots) const {
+    for(size_t column = 0; column < types.size(); column++) {
+      std::visit(
+          [&](auto& values) {
+            using T = typename std::decay_t<decltype(values)>::value_type;
+            if constexpr(std::is_same_v<T, Value>) {
+              values.push_back(load(slots, column));
+            } else if constexpr(std::is_same_v<T, int64_t>) {
+              values.push_back(slots[offsets[column]].asInt64);
+            } else {
+              values.push_back(slots[offsets[column]].asDouble);
+            }
+          },
+          batch.columns[column]);
+    }
+  }
+
+private:
+  ColumnTypes types;
+  std::vector<size_t> offsets; // the first slot of each attribute
+  size_t width = 0;
+
+  void store(int64_t value, size_t column, RowSlot* slots) const {
+    slots[offsets[column]].asInt64 = value;
+    if(types[column] == ColumnType::Mixed) {
+      slots[offsets[column] + 1].asInt64 = static_cast<int64_t>(ColumnType::Int64);
+    }
+  }
+  void store(double_t value, size_t column, RowSlot* slots) const {
+    slots[offsets[column]].asDouble = value;
+    if(types[column] == ColumnType::Mixed) {
+      slots[offsets[column] + 1].asInt64 = static_cast<int64_t>(ColumnType::Double);
+    }
+  }
+  void store(Value const& value, size_t column, RowSlot* slots) const {
+    std::visit([&](auto typedValue) { store(typedValue, column, slots); }, value);
+  }
+};
+
+} // namespace boss::engines::volcano
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <functional>
+#include <cstdint>
 #include <string>
 #include <variant>
 #include <vector>
@@ -8,11 +8,11 @@
 namespace boss::engines::volcano {
 
 using Value = std::variant<int64_t, double_t>;
-using Tuple = std::vector<Value>;
 using Schema = std::vector<std::string>;
-using Predicate = std::function<bool(Tuple const&)>;
-using Projection = std::function<Tuple(Tuple const&)>;
-using ArithmeticOp = std::function<Value(Tuple const&)>;
+
+/// the type of the values of an attribute, as known when planning (Mixed: both types of values)
+enum class ColumnType : uint8_t { Int64, Double, Mixed };
+using ColumnTypes = std::vector<ColumnType>;
 
 Value operator+(const Value& lhs, const Value& rhs) {
   return std::visit(
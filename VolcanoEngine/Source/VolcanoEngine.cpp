@@ -1,6 +1,7 @@
 
 #include "VolcanoEngine.hpp"
 #include "BOSSExpressionConversions.hpp"
+#include "RelationalOps/HashJoin.hpp"
 #include "RelationalOps/Join.hpp"
 #include "RelationalOps/Operator.hpp"
 #include "RelationalOps/Project.hpp"
@@ -13,6 +14,7 @@
 #include <Utilities.hpp>
 
 #include <memory>
+#include <memory_resource>
 #include <mutex>
 
 using boss::utilities::operator""_;
@@ -20,43 +22,65 @@ using boss::expressions::generic::isComplexExpression;
 
 namespace boss::engines::volcano {
 
-std::unique_ptr<operators::Operator> buildOperatorPipeline(ComplexExpression&& e) {
+/**
+ * @brief Builds the operators of a query plan.
+ *
+ * @param arena The memory of the query: the operators that keep rows allocate them from it.
+ */
+std::unique_ptr<operators::Operator> buildOperatorPipeline(ComplexExpression&& e,
+                                                           std::pmr::memory_resource& arena) {
   if(e.getHead() == "Table"_) {
-    auto [schema, data] = toSchemaAndData(std::move(e));
+    auto [schema, data] = toSchemaAndColumns(std::move(e));
     return std::make_unique<operators::Relation>(std::move(schema), std::move(data));
   }
   if(e.getHead() == "Project"_) {
     auto [head, unused_, dynamics, unused2_] = std::move(e).decompose();
     auto it = std::make_move_iterator(dynamics.begin());
     auto itEnd = std::make_move_iterator(dynamics.end());
-    auto input = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)));
-    auto [schema, projection] = toSchemaAndProjection(std::move(it), std::move(itEnd), *input);
+    auto input = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)), arena);
+    auto [schema, projectors] =
+        toSchemaAndProjectors(std::move(it), std::move(itEnd), *input);
     return std::make_unique<operators::Project>(std::move(input), std::move(schema),
-                                                std::move(projection));
+                                                std::move(projectors));
   }
   if(e.getHead() == "Select"_) {
     auto [head, unused_, dynamics, unused2_] = std::move(e).decompose();
     auto it = std::make_move_iterator(dynamics.begin());
-    auto input = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)));
+    auto input = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)), arena);
     auto predExpr = boss::get<ComplexExpression>(std::move(*it++));
     return std::make_unique<operators::Select>(std::move(input), std::move(predExpr));
   }
   if(e.getHead() == "Join"_) {
     auto [head, unused_, dynamics, unused2_] = std::move(e).decompose();
     auto it = std::make_move_iterator(dynamics.begin());
-    auto leftSideInput = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)));
-    auto rightSideInput = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)));
+    auto leftSideInput =
+        buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)), arena);
+    auto rightSideInput =
+        buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)), arena);
     auto predExpr = boss::get<ComplexExpression>(std::move(*it++));
-    return std::make_unique<operators::Join>(std::move(leftSideInput), std::move(rightSideInput),
-                                             std::move(predExpr));
+    // equalities between the columns of each side are joined with a hash join,
+    // and only the joins without any fall back to the nested loop join
+    auto [keys, otherConditions] = toEquiJoinKeys(
+        std::move(predExpr), leftSideInput->getSchema(), rightSideInput->getSchema());
+    if(keys.empty()) {
+      return std::make_unique<operators::Join>(std::move(leftSideInput),
+                                               std::move(rightSideInput),
+                                               toConjunction(std::move(otherConditions)));
+    }
+    auto residualExpr = otherConditions.empty()
+                            ? std::optional<ComplexExpression>()
+                            : std::optional(toConjunction(std::move(otherConditions)));
+    return std::make_unique<operators::HashJoin>(std::move(leftSideInput),
+                                                 std::move(rightSideInput), std::move(keys),
+                                                 std::move(residualExpr));
   }
   if(e.getHead() == "Top"_) {
     auto [head, unused_, dynamics, unused2_] = std::move(e).decompose();
     auto it = std::make_move_iterator(dynamics.begin());
-    auto input = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)));
+    auto input = buildOperatorPipeline(boss::get<ComplexExpression>(std::move(*it++)), arena);
     auto n = boss::get<int64_t>(std::move(*it++));
     auto orderExpr = boss::get<ComplexExpression>(std::move(*it++));
-    return std::make_unique<operators::Top>(std::move(input), n, std::move(orderExpr));
+    return std::make_unique<operators::Top>(std::move(input), n, std::move(orderExpr), arena);
   }
   throw std::runtime_error("Unknown relational operator: " + e.getHead().getName());
 }
@@ -67,28 +91,32 @@ boss::Expression Engine::evaluate(Expression&& expr) { // NOLINT
         boss::utilities::overload(
             [this](ComplexExpression&& e) -> Expression {
               // convert the query expression into a volcano pipeline
-              auto relationalOp = buildOperatorPipeline(std::move(e));
-              std::vector<ComplexExpression> exprs;
-              // process the tuples, decompose and insert into list expressions
-              while(exprs.size() < relationalOp->getSchema().size()) {
-                exprs.emplace_back("List"_());
-              }
-              while(auto tuple = relationalOp->next()) {
-                auto it = exprs.begin();
-                for(auto&& val : *tuple) {
-                  auto& expr = *it++;
-                  auto [head, unused_, dynamics, unused2_] = std::move(expr).decompose();
-                  auto dyn = std::move(dynamics); // workaround because of the capture below
-                  std::visit([&dyn](auto&& typedVal) { dyn.emplace_back(typedVal); },
-                             std::move(val));
-                  expr = ComplexExpression(std::move(head), std::move(dyn));
+              // (with the memory that its rows are allocated from, freed at once at the end)
+              std::pmr::monotonic_buffer_resource arena;
+              auto relationalOp = buildOperatorPipeline(std::move(e), arena);
+              // process the batches, and insert their values into the columns of the table
+              std::vector<ExpressionArguments> columns(relationalOp->getSchema().size());
+              while(auto batch = relationalOp->nextBatch()) {
+                for(size_t i = 0; i < columns.size(); i++) {
+                  std::visit(
+                      [&column = columns[i]](auto const& values) {
+                        for(auto const& val : values) {
+                          if constexpr(std::is_same_v<std::decay_t<decltype(val)>, Value>) {
+                            std::visit([&column](auto typedVal) { column.emplace_back(typedVal); },
+                                       val);
+                          } else {
+                            column.emplace_back(val);
+                          }
+                        }
+                      },
+                      batch->columns[i]);
                 }
               }
               // wrap the list expressions into a table expression
               ExpressionArguments args;
-              for(auto&& expr : exprs) {
+              for(auto&& column : columns) {
                 ExpressionArguments columnArgs;
-                columnArgs.emplace_back(std::move(expr));
+                columnArgs.emplace_back(ComplexExpression("List"_, std::move(column)));
                 args.emplace_back(ComplexExpression(Symbol{relationalOp->getSchema()[args.size()]},
                                                     std::move(columnArgs)));
               }